@@ -19,45 +19,68 @@
 
 */
 
-#include "cccrack.h"
+#include "cccrack_internal.h"
 
 #include <string.h>
 #include <math.h>
+#include <time.h>
 
-static void
-cccrack_rankdef_destroy(cccrack_rankdef_t *self)
+/******************************** Dual vectors ******************************/
+static struct cccrack_duals *
+cccrack_duals_from_matrices(const gf2_matrix_t *R, const gf2_matrix_t *B)
 {
-  tagging_finalize(&self->tagging);
+  struct cccrack_duals *self = NULL;
+  gf2_matrix_t *K = NULL;
+  unsigned int i, l, count;
+  unsigned int blocks;
 
-  unsigned int i;
+  l = gf2_matrix_get_cols(R);
+  blocks = GF2_MATRIX_ROW_BLOCKS(l);
+
+  /* Reduced, so that equal spans give equal vectors (and hashes) */
+  TRY(K = gf2_matrix_kernel(R, B, TRUE));
+  count = gf2_matrix_get_rows(K);
 
-  for (i = 0; i < self->h_count; ++i)
-    if (self->h_list[i] != NULL)
-      free(self->h_list[i]);
+  TRY(self = calloc(
+      1,
+      sizeof(struct cccrack_duals) + count * blocks * sizeof(uint64_t)));
 
-  if (self->h_list != NULL)
-    free(self->h_list);
+  self->refs   = 1;
+  self->length = l;
+  self->blocks = blocks;
+  self->count  = count;
 
-  for (i = 0; i < self->h_poly_count; ++i)
-    if (self->h_poly_list[i] != NULL)
-      free(self->h_poly_list[i]);
+  for (i = 0; i < count; ++i)
+    memcpy(
+        self->bits + i * blocks,
+        K->row_data[i],
+        blocks * sizeof(uint64_t));
 
-  if (self->h_poly_list != NULL)
-    free(self->h_poly_list);
+  /* FNV-1a over the vector words */
+  self->hash = 0xcbf29ce484222325ull ^ l;
+  for (i = 0; i < count * blocks; ++i)
+    self->hash = (self->hash ^ self->bits[i]) * 0x100000001b3ull;
 
-  for (i = 0; i < self->g_count; ++i)
-    if (self->g_list[i] != NULL)
-      free(self->g_list[i]);
+fail:
+  if (K != NULL)
+    gf2_matrix_destroy(K);
 
-  if (self->g_list != NULL)
-    free(self->g_list);
+  return self;
+}
 
-  for (i = 0; i < self->g_poly_count; ++i)
-    if (self->g_poly_list[i] != NULL)
-      free(self->g_poly_list[i]);
+static void
+cccrack_duals_release(struct cccrack_duals *self)
+{
+  if (__sync_sub_and_fetch(&self->refs, 1) == 0)
+    free(self);
+}
 
-  if (self->g_poly_list != NULL)
-    free(self->g_poly_list);
+/********************************* Rankdefs *********************************/
+void
+cccrack_rankdef_destroy(cccrack_rankdef_t *self)
+{
+  if (self->duals != NULL)
+    cccrack_duals_release(self->duals);
 
   free(self);
 }
@@ -65,6 +88,7 @@ cccrack_rankdef_destroy(cccrack_rankdef_t *self)
 void
 cccrack_rankdef_debug(const cccrack_rankdef_t *self)
 {
+  const uint64_t *poly;
   unsigned int i, j, k;
 
   printf("RANK DEFFICIENCY INFO (tagging ID: %d)\n", self->tagging.tagging_id);
@@ -79,15 +103,29 @@ cccrack_rankdef_debug(const cccrack_rankdef_t *self)
       self->tagging.is_gray ? 2 : 1,
       self->tagging.is_gray ? "YES" : "NO");
 
+  if (self->violation_rate >= 0)
+    printf(
+        "  Syndrome violation rate: %.4f (confidence: %.1f%%)\n",
+        self->violation_rate,
+        100 * cccrack_rankdef_get_confidence(self));
+
+  if (self->ber >= 0)
+    printf(
+        "  Viterbi BER estimate: %.4f (phase %d)\n",
+        self->ber,
+        self->decode_phase);
+
   printf("  Number of parity outputs: %d\n", self->h_count);
 
-  for (i = 0; i < self->h_poly_count; ++i) {
+  for (i = 0; i < self->h_count; ++i) {
+    poly = cccrack_rankdef_get_h_poly(self, i);
+
     printf("    H[%d] = ", i + 1);
     for (j = 0; j < self->n; ++j)
-      printf("%3lld ", self->h_poly_list[i][j]);
+      printf("%3lld ", poly[j]);
     printf(" | OCT:");
     for (j = 0; j < self->n; ++j)
-      printf("%3llo ", self->h_poly_list[i][j]);
+      printf("%3llo ", poly[j]);
 
     putchar(10);
   }
@@ -98,17 +136,19 @@ cccrack_rankdef_debug(const cccrack_rankdef_t *self)
 
   printf("\033[1m");
 
-  for (i = 0; i < self->g_poly_count; ++i) {
+  for (i = 0; i < self->g_count; ++i) {
+    poly = cccrack_rankdef_get_g_poly(self, i);
+
     printf("    G[%d] = ", i + 1);
     for (j = 0; j < self->n; ++j)
-      printf("%3lld ", self->g_poly_list[i][j]);
+      printf("%3lld ", poly[j]);
     printf(" | OCT:");
     for (j = 0; j < self->n; ++j)
-      printf("%3llo ", self->g_poly_list[i][j]);
+      printf("%3llo ", poly[j]);
     printf(" | BIN:");
     for (j = 0; j < self->n; ++j) {
       for (k = 0; k < self->K; ++k)
-        printf("%d", self->g_list[i][j +  self->n * k]);
+        printf("%d", cccrack_rankdef_get_g_bit(self, i, j + self->n * k));
       putchar(32);
     }
     putchar(10);
@@ -119,112 +159,179 @@ cccrack_rankdef_debug(const cccrack_rankdef_t *self)
   putchar(10);
 }
 
-static BOOL
-cccrack_rankdef_populate(
-    cccrack_rankdef_t *self,
-    const gf2_matrix_t *R,
-    const gf2_matrix_t *B)
+/* Point the tagging and the result arrays to the rankdef's own storage */
+static void
+cccrack_rankdef_relocate(cccrack_rankdef_t *self)
+{
+  self->tagging.dict = self->dict;
+
+  self->h_poly = self->data;
+  self->g_poly = self->h_poly + self->h_count * self->n;
+  self->g      = self->g_poly + self->g_count * self->n;
+}
 
+/*
+ * Everything but the dual vectors lives in a single allocation, sized
+ * for h_count dual polynomials and g_count generators.
+ */
+static cccrack_rankdef_t *
+cccrack_rankdef_alloc(
+    const struct tagging *tagging,
+    unsigned int n,
+    unsigned int K,
+    unsigned int h_count,
+    unsigned int g_count)
 {
-  unsigned int i, l;
-  uint8_t *row = NULL;
+  cccrack_rankdef_t *self = NULL;
+  unsigned int g_blocks = GF2_MATRIX_ROW_BLOCKS(n * K);
+  size_t words;
 
-  l = gf2_matrix_get_cols(R);
+  words = (h_count + g_count) * n + g_count * g_blocks;
 
-  self->n_a = l;
+  TRY(tagging->dict_len <= CCCRACK_MAX_DICT_LEN);
+  TRY(self = calloc(1, sizeof(cccrack_rankdef_t) + words * sizeof(uint64_t)));
 
-  for (i = 0; i < l; ++i)
-    if (gf2_matrix_col_is_null(R, i)) {
-      TRY(row = gf2_matrix_copy_row(B, i));
-      TRY(PTR_LIST_APPEND_CHECK(self->h, row) != -1);
-      row = NULL;
-    }
+  self->tagging = *tagging;
+  memcpy(self->dict, tagging->dict, tagging->dict_len);
 
-  return TRUE;
+  self->n        = n;
+  self->K        = K;
+  self->h_count  = h_count;
+  self->g_count  = g_count;
+  self->g_blocks = g_blocks;
+  self->size     = sizeof(cccrack_rankdef_t) + words * sizeof(uint64_t);
+
+  cccrack_rankdef_relocate(self);
+
+  return self;
 
 fail:
-  if (row != NULL)
-    free(row);
+  return NULL;
+}
 
-  return FALSE;
+unsigned int
+cccrack_rankdef_get_tagging_id(const cccrack_rankdef_t *self)
+{
+  return self->tagging.tagging_id;
 }
 
-static cccrack_rankdef_t *
-cccrack_rankdef_new(const struct tagging *tagging)
+unsigned int
+cccrack_rankdef_get_n(const cccrack_rankdef_t *self)
 {
-  cccrack_rankdef_t *self = NULL;
+  return self->n;
+}
 
-  ALLOCATE(self, cccrack_rankdef_t);
+unsigned int
+cccrack_rankdef_get_k(const cccrack_rankdef_t *self)
+{
+  return self->k;
+}
 
-  TRY(tagging_copy(&self->tagging, tagging));
+unsigned int
+cccrack_rankdef_get_K(const cccrack_rankdef_t *self)
+{
+  return self->K;
+}
 
-  return self;
+unsigned int
+cccrack_rankdef_get_h_count(const cccrack_rankdef_t *self)
+{
+  return self->h_count;
+}
 
-fail:
-  if (self != NULL)
-    cccrack_rankdef_destroy(self);
+const uint64_t *
+cccrack_rankdef_get_h_poly(const cccrack_rankdef_t *self, unsigned int i)
+{
+  return self->h_poly + i * self->n;
+}
 
-  return NULL;
+unsigned int
+cccrack_rankdef_get_g_count(const cccrack_rankdef_t *self)
+{
+  return self->g_count;
 }
 
-cccrack_rankdef_t *
-cccrack_rankdef_dup(const cccrack_rankdef_t *orig)
+const uint64_t *
+cccrack_rankdef_get_g_poly(const cccrack_rankdef_t *self, unsigned int i)
 {
-  cccrack_rankdef_t *self = NULL;
-  unsigned int i;
-  uint8_t *bits = NULL;
-  uint64_t *polys = NULL;
+  return self->g_poly + i * self->n;
+}
 
-  CONSTRUCT(self, cccrack_rankdef, &orig->tagging);
+uint8_t
+cccrack_rankdef_get_g_bit(
+    const cccrack_rankdef_t *self,
+    unsigned int i,
+    unsigned int j)
+{
+  return (self->g[i * self->g_blocks + GF2_MATRIX_ROW_BLOCK(j)]
+      >> GF2_MATRIX_ROW_SHIFT(j)) & 1;
+}
 
-  self->n_a = orig->n_a;
-  self->n   = orig->n;
-  self->k   = orig->k;
-  self->K   = orig->K;
-  self->muT = orig->muT;
+float
+cccrack_rankdef_get_confidence(const cccrack_rankdef_t *self)
+{
+  if (self->violation_rate < 0)
+    return -1;
 
-  self->likely = orig->likely;
+  return MAX(0, 1 - 2 * self->violation_rate);
+}
 
-  for (i = 0; i < orig->h_count; ++i) {
-    ALLOCATE_MANY(bits, orig->n_a, uint8_t);
-    memcpy(bits, orig->h_list[i], orig->n_a);
-    TRY(PTR_LIST_APPEND_CHECK(self->h, bits) != -1);
-    bits = NULL;
-  }
+float
+cccrack_rankdef_get_ber(const cccrack_rankdef_t *self)
+{
+  return self->ber;
+}
 
-  for (i = 0; i < orig->g_count; ++i) {
-    ALLOCATE_MANY(bits, orig->n * orig->K, uint8_t);
-    memcpy(bits, orig->g_list[i], orig->n * orig->K);
-    TRY(PTR_LIST_APPEND_CHECK(self->g, bits) != -1);
-    bits = NULL;
-  }
+int
+cccrack_rankdef_is_likely(const cccrack_rankdef_t *self)
+{
+  return self->likely;
+}
 
-  for (i = 0; i < orig->h_poly_count; ++i) {
-    ALLOCATE_MANY(polys, orig->n, uint64_t);
-    memcpy(polys, orig->h_poly_list[i], orig->n);
-    TRY(PTR_LIST_APPEND_CHECK(self->h_poly, polys) != -1);
-    polys = NULL;
-  }
+int
+cccrack_rankdef_is_gray(const cccrack_rankdef_t *self)
+{
+  return self->tagging.is_gray;
+}
 
-  for (i = 0; i < orig->g_poly_count; ++i) {
-    ALLOCATE_MANY(polys, orig->n, uint64_t);
-    memcpy(polys, orig->g_poly_list[i], orig->n);
-    TRY(PTR_LIST_APPEND_CHECK(self->g_poly, polys) != -1);
-    polys = NULL;
-  }
+/* Dual vectors are never modified once extracted, so dups share them */
+cccrack_rankdef_t *
+cccrack_rankdef_dup(const cccrack_rankdef_t *orig)
+{
+  cccrack_rankdef_t *self = NULL;
+
+  TRY(self = malloc(orig->size));
+
+  memcpy(self, orig, orig->size);
+  cccrack_rankdef_relocate(self);
+
+  if (self->duals != NULL)
+    __sync_fetch_and_add(&self->duals->refs, 1);
 
   return self;
 
 fail:
-  if (polys != NULL)
-    free(polys);
+  return NULL;
+}
+
+/* The template takes its own reference to the dual vectors */
+static cccrack_rankdef_t *
+cccrack_rankdef_from_duals(
+    const struct tagging *tagging,
+    struct cccrack_duals *duals)
+{
+  cccrack_rankdef_t *self = NULL;
 
-  if (bits != NULL)
-    free(bits);
+  TRY(self = cccrack_rankdef_alloc(tagging, 0, 0, 0, 0));
 
-  if (self != NULL)
-    cccrack_rankdef_destroy(self);
+  self->duals = duals;
+  __sync_fetch_and_add(&self->duals->refs, 1);
+
+  self->n_a = self->duals->length;
+
+  return self;
 
+fail:
   return NULL;
 }
 
@@ -235,18 +342,16 @@ cccrack_rankdef_from_matrices(
     const gf2_matrix_t *B)
 {
   cccrack_rankdef_t *self = NULL;
+  struct cccrack_duals *duals = NULL;
 
-  CONSTRUCT(self, cccrack_rankdef, tagging);
-
-  TRY(cccrack_rankdef_populate(self, R, B));
-
-  return self;
+  TRY(duals = cccrack_duals_from_matrices(R, B));
+  self = cccrack_rankdef_from_duals(tagging, duals);
 
 fail:
-  if (self != NULL)
-    cccrack_rankdef_destroy(self);
+  if (duals != NULL)
+    cccrack_duals_release(duals);
 
-  return NULL;
+  return self;
 }
 
 static void
@@ -257,66 +362,86 @@ cccrack_rankdef_set_second_defficiency(
   self->n = l - self->n_a;
 }
 
-static BOOL
-cccrack_rankdef_extract_duals(cccrack_rankdef_t *self)
+/*
+ * Derive a candidate for the configuration stored in the template,
+ * with room for all its dual polynomials and g_count generators.
+ */
+static cccrack_rankdef_t *
+cccrack_rankdef_derive(const cccrack_rankdef_t *template, unsigned int g_count)
 {
-  unsigned int i, j, k;
-  uint64_t poly;
-  uint64_t *list = NULL;
+  cccrack_rankdef_t *self = NULL;
 
-  for (i = 0; i < self->h_count; ++i) {
-    ALLOCATE_MANY(list, self->n, uint64_t);
+  TRY(self = cccrack_rankdef_alloc(
+      &template->tagging,
+      template->n,
+      template->K,
+      template->duals->count,
+      g_count));
 
-    for (j = 0; j < self->n; ++j) {
-      poly = 0;
-      for (k = 0; k <= self->muT; ++k)
-        poly |= self->h_list[i][self->n * k + j] << k;
+  self->duals = template->duals;
+  __sync_fetch_and_add(&self->duals->refs, 1);
 
-      list[j] = poly;
-    }
+  self->n_a = template->n_a;
+  self->k   = template->k;
+  self->muT = template->muT;
 
-    TRY(PTR_LIST_APPEND_CHECK(self->h_poly, list) != -1);
-    list = NULL;
-  }
+  self->violation_rate = -1;
+  self->ber = -1;
 
-  return TRUE;
+  return self;
 
 fail:
-  if (list != NULL)
-    free(list);
+  return NULL;
+}
 
-  return FALSE;
+static void
+cccrack_rankdef_extract_duals(cccrack_rankdef_t *self)
+{
+  unsigned int i, j, k;
+  uint64_t *list;
+
+  for (i = 0; i < self->h_count; ++i) {
+    list = self->h_poly + i * self->n;
+
+    for (j = 0; j < self->n; ++j)
+      for (k = 0; k <= self->muT; ++k)
+        list[j] |=
+            (uint64_t) cccrack_duals_get(self->duals, i, self->n * k + j) << k;
+  }
 }
 
+/*
+ * Build the linear system whose solutions are the generators, and
+ * return a basis of those solutions, one packed generator per row.
+ */
 static BOOL
-cccrack_rankdef_compute_generators(cccrack_rankdef_t *self)
+cccrack_rankdef_solve(
+    const cccrack_rankdef_t *self,
+    unsigned int threads,
+    gf2_matrix_t **G_out)
 {
   int p;
-  unsigned int i, j, k;
+  unsigned int i, j;
   unsigned int rowcnt = 0;
   unsigned int equations;
   unsigned int unknowns, rows;
-  unsigned int count = 0;
   unsigned int d = 0;
-  uint64_t poly;
-  uint64_t *list = NULL;
-  uint8_t *row = NULL;
+  unsigned int h_count = self->duals->count;
 
   gf2_matrix_t *A = NULL;
   gf2_matrix_t *B = NULL;
-
   BOOL ok = FALSE;
 
   unknowns  = self->n * self->K;
   equations = self->K + self->muT; /* TODO: Add more equations */
 
-  rows = MAX(unknowns, self->h_count * equations);
+  rows = MAX(unknowns, h_count * equations);
 
-  CONSTRUCT(A, gf2_matrix, rows, unknowns);
+  CONSTRUCT(A, gf2_matrix, rows, unknowns, FALSE);
 
   /* This system seems overdetermined but is not */
 
-  for (d = 0; d < self->h_count; ++d) {
+  for (d = 0; d < h_count; ++d) {
     for (i = 0; i < equations; ++i) {
       for (j = 0; j < unknowns; ++j) {
         /*
@@ -330,46 +455,23 @@ cccrack_rankdef_compute_generators(cccrack_rankdef_t *self)
         p = (i - equations / 2) * self->n + j;
 
         if (p >= 0 && p < unknowns)
-          gf2_matrix_set(A, rowcnt, p, self->h_list[d][j]);
+          gf2_matrix_set(
+              A,
+              rowcnt,
+              p,
+              cccrack_duals_get(self->duals, d, j));
       }
 
       ++rowcnt;
     }
   }
 
-  TRY(gf2_matrix_gauss_jordan_cols(A, &B));
-
-  for (i = 0; i < unknowns; ++i)
-    if (gf2_matrix_col_is_null(A, i)) {
-      TRY(row = gf2_matrix_copy_row(B, i));
-      ALLOCATE_MANY(list, self->n, uint64_t);
-
-      for (j = 0; j < self->n; ++j) {
-        poly = 0;
-        for (k = 0; k <= self->muT; ++k)
-          poly |= row[self->n * k + j] << (self->K - k - 1);
-
-        list[j] = poly;
-      }
-
-      TRY(PTR_LIST_APPEND_CHECK(self->g_poly, list) != -1);
-      list = NULL;
-
-      TRY(PTR_LIST_APPEND_CHECK(self->g, row) != -1);
-      row = NULL;
-    }
-
-  self->likely = self->g_poly_count == self->k;
+  TRY(gf2_matrix_gauss_jordan_cols_mt(A, &B, threads));
+  TRY(*G_out = gf2_matrix_kernel(A, B, FALSE));
 
   ok = TRUE;
 
 fail:
-  if (row != NULL)
-    free(row);
-
-  if (list != NULL)
-    free(list);
-
   if (A != NULL)
     gf2_matrix_destroy(A);
 
@@ -379,214 +481,3153 @@ fail:
   return ok;
 }
 
-void
-cccrack_destroy(cccrack_t *self)
+static void
+cccrack_rankdef_extract_generators(
+    cccrack_rankdef_t *self,
+    const gf2_matrix_t *G)
+{
+  unsigned int i, j, k;
+  uint64_t *list;
+
+  for (i = 0; i < self->g_count; ++i) {
+    list = self->g_poly + i * self->n;
+
+    memcpy(
+        self->g + i * self->g_blocks,
+        G->row_data[i],
+        self->g_blocks * sizeof(uint64_t));
+
+    for (j = 0; j < self->n; ++j)
+      for (k = 0; k < self->K; ++k)
+        list[j] |= (uint64_t) cccrack_rankdef_get_g_bit(
+            self,
+            i,
+            self->n * k + j) << (self->K - k - 1);
+  }
+
+  self->likely = self->g_count == self->k;
+}
+
+/****************************** Unique index ********************************/
+#define CCCRACK_UNIQUE_INITIAL_BUCKETS 64
+
+static void
+cccrack_unique_index_destroy(struct cccrack_unique_index *self)
 {
   unsigned int i;
 
-  if (self->symtag != NULL)
-    symtag_destroy(self->symtag);
+  for (i = 0; i < self->unique_count; ++i) {
+    if (self->unique_list[i]->key != NULL)
+      free(self->unique_list[i]->key);
 
-  for (i = 0; i < self->rankdef_count; ++i)
-    if (self->rankdef_list[i] != NULL)
-      cccrack_rankdef_destroy(self->rankdef_list[i]);
+    VECTOR_FREE(self->unique_list[i]->tagging);
+    free(self->unique_list[i]);
+  }
+
+  VECTOR_FREE(self->unique);
 
-  if (self->rankdef_list != NULL)
-    free(self->rankdef_list);
+  if (self->bucket_list != NULL)
+    free(self->bucket_list);
 
   free(self);
 }
 
-static BOOL
-cccrack_push_rankdef(cccrack_t *self, cccrack_rankdef_t *def)
+static struct cccrack_unique_index *
+cccrack_unique_index_new(void)
 {
-  TRY(PTR_LIST_APPEND_CHECK(self->rankdef, def) != -1);
+  struct cccrack_unique_index *self = NULL;
 
-  return TRUE;
+  ALLOCATE(self, struct cccrack_unique_index);
+
+  self->bucket_count = CCCRACK_UNIQUE_INITIAL_BUCKETS;
+  ALLOCATE_MANY(self->bucket_list, self->bucket_count, struct cccrack_unique *);
+
+  return self;
 
 fail:
-  return FALSE;
+  if (self != NULL)
+    cccrack_unique_index_destroy(self);
+
+  return NULL;
 }
 
-static BOOL
-cccrack_eval_candidate(
-    cccrack_t *self,
-    const cccrack_rankdef_t *template)
+static int
+cccrack_unique_compare_words(
+    const uint64_t *a,
+    const uint64_t *b,
+    unsigned int len)
 {
-  cccrack_rankdef_t *dup = NULL;
-  BOOL should_save;
-  BOOL ok = FALSE;
+  unsigned int i;
 
-  TRY(dup = cccrack_rankdef_dup(template));
-  TRY(cccrack_rankdef_extract_duals(dup));
-  TRY(cccrack_rankdef_compute_generators(dup));
+  for (i = 0; i < len; ++i)
+    if (a[i] != b[i])
+      return a[i] < b[i] ? -1 : 1;
 
-  should_save =
-      (self->params.all || cccrack_rankdef_is_likely(dup));
+  return 0;
+}
 
-  if (should_save) {
-    TRY(cccrack_push_rankdef(self, dup));
-  } else {
-    cccrack_rankdef_destroy(dup);
-  }
+/*
+ * Writes into out the rows of m (rows x cols, row-major) in the order given
+ * by perm, with the columns sorted by their tuple across those rows. For a
+ * fixed row order, this is the lexicographically smallest arrangement.
+ * col is scratch space for cols entries.
+ */
+static void
+cccrack_unique_sort_cols(
+    uint64_t *out,
+    const uint64_t *m,
+    const unsigned int *perm,
+    unsigned int *col,
+    unsigned int rows,
+    unsigned int cols)
+{
+  unsigned int i, j, r, tmp;
+  int cmp;
 
-  dup = NULL;
+  for (i = 0; i < cols; ++i)
+    col[i] = i;
 
-  ok = TRUE;
+  for (i = 1; i < cols; ++i) {
+    tmp = col[i];
 
-fail:
-  if (dup != NULL)
-    cccrack_rankdef_destroy(dup);
+    for (j = i; j > 0; --j) {
+      cmp = 0;
+      for (r = 0; r < rows && cmp == 0; ++r)
+        if (m[perm[r] * cols + col[j - 1]] != m[perm[r] * cols + tmp])
+          cmp = m[perm[r] * cols + col[j - 1]] < m[perm[r] * cols + tmp]
+              ? -1
+              : 1;
 
-  return ok;
+      if (cmp <= 0)
+        break;
+
+      col[j] = col[j - 1];
+    }
+
+    col[j] = tmp;
+  }
+
+  for (r = 0; r < rows; ++r)
+    for (i = 0; i < cols; ++i)
+      out[r * cols + i] = m[perm[r] * cols + col[i]];
 }
 
+/*
+ * Codes are the same up to the order of their generators and a shared
+ * permutation of their outputs. The canonical form is the smallest
+ * row-major arrangement of the generator matrix over both permutations:
+ * we enumerate the orders of the shorter side (Heap's algorithm) and sort
+ * the other one. Past CCCRACK_UNIQUE_MAX_PERM rows we keep the order we
+ * were given, which may split equivalent codes but never merges distinct
+ * ones.
+ */
 static BOOL
-cccrack_enumerate_configs(cccrack_t *self, cccrack_rankdef_t *template)
+cccrack_unique_canonicalize(
+    uint64_t *out,
+    const uint64_t *m,
+    unsigned int rows,
+    unsigned int cols)
 {
-  unsigned int k, n, n_a, n_k;
-  unsigned int z;
+  uint64_t *tmp = NULL;
+  unsigned int *perm = NULL;
+  unsigned int *col = NULL;
+  unsigned int c[CCCRACK_UNIQUE_MAX_PERM];
+  unsigned int i, swp;
   BOOL ok = FALSE;
 
-  /*
-   * Now we have n_a and n. We are ready to enumerate all
-   * possible values for k and muT
-   */
+  ALLOCATE_MANY(perm, rows, unsigned int);
+  ALLOCATE_MANY(col, cols, unsigned int);
 
-  n   = template->n;
-  n_a = template->n_a;
+  for (i = 0; i < rows; ++i)
+    perm[i] = i;
 
-  for (k = 1; k < n; ++k) {
-    n_k = n - k;
-    for (z = 1; z <= n_k; ++z) {
-      template->muT = template->n_a  - (template->n_a * k) / n - z;
-      template->k = k;
-      template->K = template->muT / template->k + 1;
+  cccrack_unique_sort_cols(out, m, perm, col, rows, cols);
 
-      /* This is something interesting. Study case when K = 1 */
-      if (template->K > 1)
-        TRY(cccrack_eval_candidate(self, template));
-    }
+  if (rows > CCCRACK_UNIQUE_MAX_PERM) {
+    ok = TRUE;
+    goto fail;
   }
 
-  ok = TRUE;
+  ALLOCATE_MANY(tmp, rows * cols, uint64_t);
 
-fail:
-  return ok;
-}
+  for (i = 0; i < rows; ++i)
+    c[i] = 0;
 
-static BOOL
-cccrack_helper_save_tagging(
-    const char *path,
-    const uint8_t *bits,
-    size_t len)
-{
-  FILE *fp = NULL;
-  BOOL ok = FALSE;
+  i = 1;
+  while (i < rows) {
+    if (c[i] < i) {
+      swp = perm[i];
+      perm[i] = perm[i & 1 ? c[i] : 0];
+      perm[i & 1 ? c[i] : 0] = swp;
 
-  TRY(fp = fopen(path, "wb"));
+      cccrack_unique_sort_cols(tmp, m, perm, col, rows, cols);
+      if (cccrack_unique_compare_words(tmp, out, rows * cols) < 0)
+        memcpy(out, tmp, rows * cols * sizeof(uint64_t));
 
-  while (len-- > 0)
-    fputc('0' + *bits++, fp);
+      ++c[i];
+      i = 1;
+    } else {
+      c[i] = 0;
+      ++i;
+    }
+  }
 
   ok = TRUE;
 
 fail:
-  if (fp != NULL)
-    fclose(fp);
+  if (tmp != NULL)
+    free(tmp);
+
+  if (col != NULL)
+    free(col);
+
+  if (perm != NULL)
+    free(perm);
 
   return ok;
 }
 
-static BOOL
-cccrack_on_tagging(
-    void *private,
-    const struct tagging *tagging,
-    const uint8_t *bits,
-    size_t len)
+static uint64_t *
+cccrack_unique_make_key(const cccrack_rankdef_t *def, unsigned int *len)
 {
-  unsigned int width;
-  unsigned int height;
-  unsigned int l, i, j, p;
-  gf2_matrix_t *R = NULL;
-  gf2_matrix_t *B = NULL;
-  cccrack_rankdef_t *rankdef = NULL;
-  cccrack_t *self = (cccrack_t *) private;
-  BOOL have_n;
-  BOOL have_kays;
-  BOOL ok = FALSE;
-
-  if (self->params.tagging != -1 && self->params.tagging != tagging->tagging_id)
-    return TRUE;
-
-  if (self->params.dumpfile != NULL)
-    TRY(cccrack_helper_save_tagging(self->params.dumpfile, bits, len));
+  uint64_t *key = NULL;
+  uint64_t *t = NULL;
+  unsigned int i, j;
 
-  if (!self->params.no_gray && !tagging->is_gray)
-    return TRUE;
+  *len = 4 + def->g_count * def->n;
 
-  width = floor(sqrt(len));
+  ALLOCATE_MANY(key, *len, uint64_t);
 
-  if (width > CCCRACK_MAX_WIDTH)
-    width = CCCRACK_MAX_WIDTH;
+  key[0] = def->k;
+  key[1] = def->n;
+  key[2] = def->K;
+  key[3] = def->g_count;
 
-  /* TODO: Repeat for several regions */
-  for (l = 2; !ok && l < width; ++l) {
-    height = len / l;
-    if (height > width * CCCRACK_MAX_REL_HEIGHT)
-      height = width * CCCRACK_MAX_REL_HEIGHT;
+  if (def->g_count == 0 || def->n == 0)
+    return key;
 
-    /* Construct received code matrix */
-    CONSTRUCT(R, gf2_matrix, height, l);
+  /*
+   * Enumerate generator orders when there are fewer generators than
+   * outputs, output orders (on the transpose) otherwise. Either form is
+   * canonical, and which one we use depends only on the header above.
+   */
+  if (def->g_count <= def->n) {
+    TRY(cccrack_unique_canonicalize(
+        key + 4,
+        def->g_poly,
+        def->g_count,
+        def->n));
+  } else {
+    ALLOCATE_MANY(t, def->g_count * def->n, uint64_t);
+
+    for (i = 0; i < def->g_count; ++i)
+      for (j = 0; j < def->n; ++j)
+        t[j * def->g_count + i] = def->g_poly[i * def->n + j];
+
+    TRY(cccrack_unique_canonicalize(key + 4, t, def->n, def->g_count));
+    free(t);
+  }
+
+  return key;
+
+fail:
+  if (t != NULL)
+    free(t);
+
+  if (key != NULL)
+    free(key);
+
+  return NULL;
+}
+
+static BOOL
+cccrack_unique_index_grow(struct cccrack_unique_index *self)
+{
+  struct cccrack_unique **bucket_list = NULL;
+  struct cccrack_unique *entry;
+  unsigned int count = self->bucket_count << 1;
+  unsigned int i, b;
+
+  ALLOCATE_MANY(bucket_list, count, struct cccrack_unique *);
+
+  for (i = 0; i < self->unique_count; ++i) {
+    entry = self->unique_list[i];
+    b = entry->hash & (count - 1);
+    entry->next = bucket_list[b];
+    bucket_list[b] = entry;
+  }
+
+  free(self->bucket_list);
+  self->bucket_list  = bucket_list;
+  self->bucket_count = count;
+
+  return TRUE;
+
+fail:
+  return FALSE;
+}
+
+/*
+ * Registers the tagging of def under its code. Returns 1 if the code is
+ * new, 0 if it was already known and -1 on error.
+ */
+static int
+cccrack_unique_index_add(
+    struct cccrack_unique_index *self,
+    const cccrack_rankdef_t *def)
+{
+  struct cccrack_unique *entry = NULL;
+  uint64_t *key = NULL;
+  uint64_t hash = 0xcbf29ce484222325ull;
+  unsigned int len, i, b;
+  unsigned int id = def->tagging.tagging_id;
+
+  TRY(key = cccrack_unique_make_key(def, &len));
+
+  for (i = 0; i < len; ++i)
+    hash = (hash ^ key[i]) * 0x100000001b3ull;
+
+  b = hash & (self->bucket_count - 1);
+
+  for (entry = self->bucket_list[b]; entry != NULL; entry = entry->next)
+    if (entry->hash == hash
+        && entry->key_len == len
+        && cccrack_unique_compare_words(entry->key, key, len) == 0)
+      break;
+
+  if (entry != NULL) {
+    free(key);
+    key = NULL;
+
+    /* Several configurations of the same tagging may agree */
+    if (entry->tagging_list[entry->tagging_count - 1] != id)
+      TRY(VECTOR_PUSH(entry->tagging, id) != -1);
+
+    return 0;
+  }
+
+  if (self->unique_count >= self->bucket_count - self->bucket_count / 4)
+    TRY(cccrack_unique_index_grow(self));
+
+  ALLOCATE(entry, struct cccrack_unique);
+  entry->key     = key;
+  entry->key_len = len;
+  key = NULL;
+  TRY(VECTOR_PUSH(entry->tagging, id) != -1);
+  TRY(VECTOR_PUSH(self->unique, entry) != -1);
+
+  entry->hash = hash;
+
+  b = hash & (self->bucket_count - 1);
+  entry->next = self->bucket_list[b];
+  self->bucket_list[b] = entry;
+
+  return 1;
+
+fail:
+  if (entry != NULL) {
+    if (entry->key != NULL)
+      free(entry->key);
+
+    VECTOR_FREE(entry->tagging);
+    free(entry);
+  }
+
+  if (key != NULL)
+    free(key);
+
+  return -1;
+}
+
+/********************************* Cracker **********************************/
+void
+cccrack_destroy(cccrack_t *self)
+{
+  unsigned int i;
+
+  if (self->symtag != NULL)
+    symtag_destroy(self->symtag);
+
+  if (self->rowsel != NULL) {
+    for (i = 0; i < cccrack_get_max_width(self); ++i)
+      if (self->rowsel[i] != NULL)
+        free(self->rowsel[i]);
+
+    free(self->rowsel);
+  }
+
+  for (i = 0; i < self->rankdef_count; ++i)
+    if (self->rankdef_list[i] != NULL)
+      cccrack_rankdef_destroy(self->rankdef_list[i]);
+
+  VECTOR_FREE(self->rankdef);
+
+  /* Left behind by a failed run */
+  for (i = 0; i < self->pending_count; ++i)
+    cccrack_rankdef_destroy(self->pending_list[i]);
+
+  VECTOR_FREE(self->pending);
+  VECTOR_FREE(self->finished);
+
+  if (self->index != NULL)
+    cccrack_unique_index_destroy(self->index);
+
+  if (self->have_lock)
+    pthread_mutex_destroy(&self->lock);
+
+  free(self);
+}
+
+/*
+ * Candidates of the same tagging are pushed by the same worker and must
+ * keep their relative order, hence a stable merge sort.
+ */
+static void
+cccrack_sort_candidates(
+    cccrack_rankdef_t **list,
+    cccrack_rankdef_t **tmp,
+    unsigned int count)
+{
+  unsigned int half = count / 2;
+  unsigned int i = 0, j = half, k = 0;
+
+  if (count < 2)
+    return;
+
+  cccrack_sort_candidates(list, tmp, half);
+  cccrack_sort_candidates(list + half, tmp, count - half);
+
+  while (i < half && j < count) {
+    if (list[j]->tagging.tagging_id < list[i]->tagging.tagging_id)
+      tmp[k++] = list[j++];
+    else
+      tmp[k++] = list[i++];
+  }
+
+  while (i < half)
+    tmp[k++] = list[i++];
+
+  while (j < count)
+    tmp[k++] = list[j++];
+
+  memcpy(list, tmp, count * sizeof(cccrack_rankdef_t *));
+}
+
+/* Registers def, and hands it to the sink or keeps it. Takes ownership */
+static BOOL
+cccrack_deliver_rankdef(cccrack_t *self, cccrack_rankdef_t *def)
+{
+  BOOL ok;
+  int novel = 1;
+
+  if (self->index != NULL)
+    novel = cccrack_unique_index_add(self->index, def);
+
+  if (novel != 1) {
+    ok = novel == 0;
+    cccrack_rankdef_destroy(def);
+  } else if (self->params.on_candidate != NULL) {
+    ok = (self->params.on_candidate) (self->params.private, def);
+    cccrack_rankdef_destroy(def);
+  } else {
+    ok = VECTOR_PUSH(self->rankdef, def) != -1;
+    if (!ok)
+      cccrack_rankdef_destroy(def);
+  }
+
+  return ok;
+}
+
+/*
+ * Deliver the pending candidates of finished taggings. If some other
+ * thread is delivering, it will pick ours up before it stops.
+ */
+static BOOL
+cccrack_flush_pending(cccrack_t *self)
+{
+  cccrack_rankdef_t **batch = NULL;
+  unsigned int count, i, j;
+  BOOL ok = TRUE;
+
+  pthread_mutex_lock(&self->lock);
+
+  if (self->delivering) {
+    pthread_mutex_unlock(&self->lock);
+    return TRUE;
+  }
+
+  self->delivering = TRUE;
+
+  while (ok && !self->sink_failed) {
+    for (count = 0, i = 0; i < self->pending_count; ++i)
+      if (self->pending_list[i]->tagging.tagging_id < self->next_tagging)
+        ++count;
+
+    if (count == 0)
+      break;
+
+    /* Second half is scratch space for the sort */
+    if ((batch = malloc(2 * count * sizeof(cccrack_rankdef_t *))) == NULL) {
+      ok = FALSE;
+      break;
+    }
+
+    for (count = 0, i = 0, j = 0; i < self->pending_count; ++i)
+      if (self->pending_list[i]->tagging.tagging_id < self->next_tagging)
+        batch[count++] = self->pending_list[i];
+      else
+        self->pending_list[j++] = self->pending_list[i];
+
+    self->pending_count = j;
+
+    pthread_mutex_unlock(&self->lock);
+
+    cccrack_sort_candidates(batch, batch + count, count);
+
+    for (i = 0; i < count; ++i)
+      if (ok)
+        ok = cccrack_deliver_rankdef(self, batch[i]);
+      else
+        cccrack_rankdef_destroy(batch[i]);
+
+    free(batch);
+
+    pthread_mutex_lock(&self->lock);
+  }
+
+  if (!ok)
+    self->sink_failed = TRUE;
+
+  ok = !self->sink_failed;
+  self->delivering = FALSE;
+
+  pthread_mutex_unlock(&self->lock);
+
+  return ok;
+}
+
+/* Called once per tagging, when it is done with whatever outcome */
+static BOOL
+cccrack_finish_tagging(cccrack_t *self, uint64_t id)
+{
+  unsigned int i, done;
+  BOOL ok = TRUE;
+
+  pthread_mutex_lock(&self->lock);
+
+  if (id == self->next_tagging) {
+    /* Taggings that finished before this one may follow it */
+    for (done = 0;
+        done < self->finished_count
+        && self->finished_list[done] == id + done + 1;
+        ++done);
+
+    self->next_tagging = id + done + 1;
+
+    if (done > 0) {
+      self->finished_count -= done;
+      memmove(
+          self->finished_list,
+          self->finished_list + done,
+          self->finished_count * sizeof(uint64_t));
+    }
+  } else if (VECTOR_PUSH(self->finished, id) != -1) {
+    for (i = self->finished_count - 1;
+        i > 0 && self->finished_list[i - 1] > id;
+        --i)
+      self->finished_list[i] = self->finished_list[i - 1];
+
+    self->finished_list[i] = id;
+  } else {
+    ok = FALSE;
+  }
+
+  pthread_mutex_unlock(&self->lock);
+
+  return ok && cccrack_flush_pending(self);
+}
+
+/*
+ * Takes ownership of def. Outside cccrack_run (i.e. in stream mode),
+ * candidates come from a single thread and are delivered right away.
+ */
+static BOOL
+cccrack_push_rankdef(cccrack_t *self, cccrack_rankdef_t *def)
+{
+  BOOL ok;
+
+  if (!self->ordered)
+    return cccrack_deliver_rankdef(self, def);
+
+  pthread_mutex_lock(&self->lock);
+  ok = !self->sink_failed && VECTOR_PUSH(self->pending, def) != -1;
+  pthread_mutex_unlock(&self->lock);
+
+  if (!ok)
+    cccrack_rankdef_destroy(def);
+
+  return ok;
+}
+
+/*
+ * The generator system only depends on the dual vectors, n, K and muT.
+ * Different (k, z) pairs often lead to the same system, so solved
+ * systems are kept here while the configurations of a template are
+ * enumerated.
+ */
+#define CCCRACK_SOLVE_CACHE_SIZE 16
+
+struct cccrack_solve_cache_entry {
+  uint64_t hash;
+  unsigned int n, K, muT;
+  gf2_matrix_t *G;
+};
+
+struct cccrack_solve_cache {
+  struct cccrack_solve_cache_entry entries[CCCRACK_SOLVE_CACHE_SIZE];
+  unsigned int count;
+  unsigned int next; /* Next entry to evict */
+};
+
+static void
+cccrack_solve_cache_finalize(struct cccrack_solve_cache *self)
+{
+  unsigned int i;
+
+  for (i = 0; i < self->count; ++i)
+    gf2_matrix_destroy(self->entries[i].G);
+
+  self->count = 0;
+  self->next  = 0;
+}
+
+static const struct cccrack_solve_cache_entry *
+cccrack_solve_cache_lookup(
+    const struct cccrack_solve_cache *self,
+    const cccrack_rankdef_t *template)
+{
+  const struct cccrack_solve_cache_entry *entry;
+  unsigned int i;
+
+  for (i = 0; i < self->count; ++i) {
+    entry = self->entries + i;
+    if (entry->hash == template->duals->hash
+        && entry->n == template->n
+        && entry->K == template->K
+        && entry->muT == template->muT)
+      return entry;
+  }
+
+  return NULL;
+}
+
+/* Takes ownership of G */
+static const struct cccrack_solve_cache_entry *
+cccrack_solve_cache_insert(
+    struct cccrack_solve_cache *self,
+    const cccrack_rankdef_t *template,
+    gf2_matrix_t *G)
+{
+  struct cccrack_solve_cache_entry *entry;
+
+  if (self->count < CCCRACK_SOLVE_CACHE_SIZE) {
+    entry = self->entries + self->count++;
+  } else {
+    entry = self->entries + self->next;
+    self->next = (self->next + 1) % CCCRACK_SOLVE_CACHE_SIZE;
+
+    gf2_matrix_destroy(entry->G);
+  }
+
+  entry->hash = template->duals->hash;
+  entry->n    = template->n;
+  entry->K    = template->K;
+  entry->muT  = template->muT;
+  entry->G    = G;
+
+  return entry;
+}
+
+/*
+ * Fork/join: run each of the count jobs, laid out size bytes apart (0 if
+ * they all share one), in its own thread. The first one runs in the
+ * calling thread, and so do those whose thread cannot be started, so
+ * every job always runs unless the thread list cannot be allocated.
+ */
+static BOOL
+cccrack_helper_fork_join(
+    void *jobs,
+    size_t size,
+    unsigned int count,
+    void *(*run) (void *))
+{
+  pthread_t *thread = NULL;
+  BOOL *started = NULL;
+  unsigned int i;
+  BOOL ok = FALSE;
+
+  ALLOCATE_MANY(thread, count, pthread_t);
+  ALLOCATE_MANY(started, count, BOOL);
+
+  for (i = 1; i < count; ++i)
+    started[i] = pthread_create(
+        thread + i,
+        NULL,
+        run,
+        (uint8_t *) jobs + i * size) == 0;
+
+  (run) (jobs);
+
+  for (i = 1; i < count; ++i)
+    if (started[i])
+      pthread_join(thread[i], NULL);
+    else
+      (run) ((uint8_t *) jobs + i * size);
+
+  ok = TRUE;
+
+fail:
+  if (started != NULL)
+    free(started);
+
+  if (thread != NULL)
+    free(thread);
+
+  return ok;
+}
+
+static double
+cccrack_helper_get_time(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return ts.tv_sec + 1e-9 * ts.tv_nsec;
+}
+
+/* Once the time budget runs out, analyses give up where they are */
+static BOOL
+cccrack_out_of_time(cccrack_t *self)
+{
+  if (self->deadline <= 0)
+    return FALSE;
+
+  if (__atomic_load_n(&self->out_of_time, __ATOMIC_RELAXED))
+    return TRUE;
+
+  if (cccrack_helper_get_time() < self->deadline)
+    return FALSE;
+
+  __atomic_store_n(&self->out_of_time, TRUE, __ATOMIC_RELAXED);
+
+  return TRUE;
+}
+
+static BOOL
+cccrack_helper_save_tagging(
+    const char *path,
+    const uint8_t *bits,
+    size_t len)
+{
+  FILE *fp = NULL;
+  BOOL ok = FALSE;
+
+  TRY(fp = fopen(path, "wb"));
+
+  while (len-- > 0)
+    fputc('0' + *bits++, fp);
+
+  ok = TRUE;
+
+fail:
+  if (fp != NULL)
+    fclose(fp);
+
+  return ok;
+}
+
+/* Same, from a packed stream */
+static BOOL
+cccrack_helper_save_packed(
+    const char *path,
+    const uint64_t *packed,
+    uint64_t len)
+{
+  FILE *fp = NULL;
+  char buf[64];
+  uint64_t p;
+  unsigned int i, count;
+  BOOL ok = FALSE;
+
+  TRY(fp = fopen(path, "wb"));
+
+  for (p = 0; p < len; p += count) {
+    count = MIN(64, len - p);
+
+    for (i = 0; i < count; ++i)
+      buf[i] = '0' + ((packed[p >> 6] >> i) & 1);
+
+    TRY(fwrite(buf, 1, count, fp) == count);
+  }
+
+  ok = TRUE;
+
+fail:
+  if (fp != NULL)
+    fclose(fp);
+
+  return ok;
+}
+
+/***************************** Viterbi decoding *****************************/
+/*
+ * Rate 1/n candidates are decoded over the whole capture, trying every
+ * output phase. The metric of the best path estimates the number of
+ * channel errors.
+ */
+struct cccrack_decode_job {
+  const cccrack_rankdef_t *candidate;
+  const struct cccrack_capture *capture;
+  const uint64_t *taps;
+  unsigned int phase;
+  unsigned int stride; /* Phases handled by each job */
+  BOOL huge;
+  uint8_t **out;       /* One buffer per phase, or NULL */
+  uint64_t *steps;     /* One per phase */
+  uint64_t *errors;    /* One per phase */
+  BOOL ok;
+};
+
+static void
+cccrack_decode_job_run(struct cccrack_decode_job *self)
+{
+  viterbi_t *viterbi = NULL;
+  unsigned int n = self->candidate->n;
+  unsigned int phase;
+
+  TRY(viterbi = viterbi_new(n, self->candidate->K, self->taps, self->huge));
+
+  for (phase = self->phase; phase < n; phase += self->stride)
+    TRY(viterbi_decode(
+        viterbi,
+        self->capture->packed,
+        self->capture->len,
+        phase,
+        self->out != NULL ? self->out[phase] : NULL,
+        self->steps + phase,
+        self->errors + phase));
+
+  self->ok = TRUE;
+
+fail:
+  if (viterbi != NULL)
+    viterbi_destroy(viterbi);
+}
+
+static void *
+cccrack_decode_job_thread(void *data)
+{
+  cccrack_decode_job_run((struct cccrack_decode_job *) data);
+
+  return NULL;
+}
+
+static BOOL
+cccrack_decode_save(
+    cccrack_t *self,
+    const cccrack_rankdef_t *candidate,
+    const uint8_t *bits,
+    uint64_t len)
+{
+  char *path = NULL;
+  BOOL ok = FALSE;
+
+  TRY(path = strbuild(
+      "%s.%u.%u-%u-%u",
+      self->params.decodefile,
+      candidate->tagging.tagging_id,
+      candidate->k,
+      candidate->n,
+      candidate->K));
+
+  /*
+   * Each tagging is handled by a single worker, so no other thread
+   * writes to this path and the lock is not needed.
+   */
+  TRY(cccrack_helper_save_tagging(path, bits, len));
+
+  ok = TRUE;
+
+fail:
+  if (path != NULL)
+    free(path);
+
+  return ok;
+}
+
+static BOOL
+cccrack_decode(
+    cccrack_t *self,
+    cccrack_rankdef_t *candidate,
+    const struct cccrack_capture *capture)
+{
+  struct cccrack_decode_job *jobs = NULL;
+  uint64_t taps[VITERBI_MAX_N];
+  uint64_t *steps = NULL;
+  uint64_t *errors = NULL;
+  uint8_t **out = NULL;
+  unsigned int n = candidate->n;
+  unsigned int threads = 1;
+  unsigned int i, j, m, best = 0;
+  BOOL ok = FALSE;
+
+  if (capture == NULL || !self->params.decode)
+    return TRUE;
+
+  /* Codes the decoder cannot handle are reported without a BER */
+  if (candidate->k != 1
+      || candidate->g_count == 0
+      || !viterbi_is_supported(n, candidate->K))
+    return TRUE;
+
+  for (j = 0; j < n; ++j) {
+    taps[j] = 0;
+    for (m = 0; m < candidate->K; ++m)
+      taps[j] |=
+          (uint64_t) cccrack_rankdef_get_g_bit(candidate, 0, n * m + j) << m;
+  }
+
+  threads = MIN(cccrack_get_inner_threads(self), n);
+
+  ALLOCATE_MANY(steps, n, uint64_t);
+  ALLOCATE_MANY(errors, n, uint64_t);
+  ALLOCATE_MANY(jobs, threads, struct cccrack_decode_job);
+
+  if (self->params.decodefile != NULL) {
+    ALLOCATE_MANY(out, n, uint8_t *);
+    for (i = 0; i < n; ++i)
+      ALLOCATE_MANY(out[i], capture->len / n + 1, uint8_t);
+  }
+
+  for (i = 0; i < threads; ++i) {
+    jobs[i].candidate = candidate;
+    jobs[i].capture   = capture;
+    jobs[i].taps      = taps;
+    jobs[i].phase     = i;
+    jobs[i].stride    = threads;
+    jobs[i].huge      = self->params.hugepages;
+    jobs[i].out       = out;
+    jobs[i].steps     = steps;
+    jobs[i].errors    = errors;
+  }
+
+  TRY(cccrack_helper_fork_join(
+      jobs,
+      sizeof(struct cccrack_decode_job),
+      threads,
+      cccrack_decode_job_thread));
+
+  for (i = 0; i < threads; ++i)
+    TRY(jobs[i].ok);
+
+  if (steps[0] == 0) {
+    ok = TRUE;
+    goto fail;
+  }
+
+  /* Every phase decodes about the same number of steps */
+  for (i = 1; i < n; ++i)
+    if (steps[i] > 0
+        && (double) errors[i] / steps[i] < (double) errors[best] / steps[best])
+      best = i;
+
+  candidate->ber = (float) errors[best] / (steps[best] * n);
+  candidate->decode_phase = best;
+
+  if (out != NULL)
+    TRY(cccrack_decode_save(self, candidate, out[best], steps[best]));
+
+  ok = TRUE;
+
+fail:
+  if (jobs != NULL)
+    free(jobs);
+
+  if (out != NULL) {
+    for (i = 0; i < n; ++i)
+      if (out[i] != NULL)
+        free(out[i]);
+
+    free(out);
+  }
+
+  if (steps != NULL)
+    free(steps);
+
+  if (errors != NULL)
+    free(errors);
+
+  return ok;
+}
+
+/************************** Syndrome verification ***************************/
+/*
+ * The dual polynomials of a valid candidate are parity checks of the
+ * coded stream: the n * (muT + 1) bits starting at any codeword boundary,
+ * ANDed with the interleaved taps of h, have even parity. Checks are
+ * evaluated for every output phase over the packed stream, and the best
+ * phase gives the violation rate.
+ */
+#define CCCRACK_VERIFY_MIN_CHUNK 65536 /* Checks per thread, at least */
+
+struct cccrack_verify_job {
+  const cccrack_rankdef_t *candidate;
+  const uint64_t *checks; /* h_count vectors of blocks words */
+  unsigned int blocks;
+  const uint64_t *packed;
+  uint64_t first;  /* First codeword */
+  uint64_t count;  /* Number of codewords */
+  uint64_t *violations; /* One per phase */
+};
+
+static void
+cccrack_verify_job_run(struct cccrack_verify_job *self)
+{
+  const uint64_t *h;
+  unsigned int n = self->candidate->n;
+  unsigned int i, b, phase;
+  uint64_t m, pos, x, violations;
+
+  for (phase = 0; phase < n; ++phase) {
+    violations = 0;
+
+    for (i = 0; i < self->candidate->h_count; ++i) {
+      h = self->checks + i * self->blocks;
+      pos = self->first * n + phase;
+
+      for (m = 0; m < self->count; ++m, pos += n) {
+        x = 0;
+        for (b = 0; b < self->blocks; ++b)
+          x ^= symtag_packed_get_word(self->packed, pos + (b << 6)) & h[b];
+
+        violations += __builtin_parityll(x);
+      }
+    }
+
+    self->violations[phase] = violations;
+  }
+}
+
+static void *
+cccrack_verify_job_thread(void *data)
+{
+  cccrack_verify_job_run((struct cccrack_verify_job *) data);
+
+  return NULL;
+}
+
+/* Leaves the violation rate in [0, 1] in *rate, or -1 if nothing was checked */
+static BOOL
+cccrack_verify_candidate(
+    cccrack_t *self,
+    const cccrack_rankdef_t *candidate,
+    const struct cccrack_capture *capture,
+    float *rate)
+{
+  struct cccrack_verify_job *jobs = NULL;
+  uint64_t *checks = NULL;
+  unsigned int n = candidate->n;
+  unsigned int len, blocks;
+  unsigned int threads;
+  unsigned int i, j, phase;
+  uint64_t limit, codewords;
+  uint64_t violations, best = 0;
+  BOOL ok = FALSE;
+
+  *rate = -1;
+
+  limit = capture->len;
+  if (self->params.verify < 1)
+    limit *= self->params.verify;
+
+  len = MIN(candidate->n_a, n * (candidate->muT + 1));
+  blocks = GF2_MATRIX_ROW_BLOCKS(len);
+
+  /* Every phase must have the same number of checks */
+  if (candidate->h_count == 0 || limit < len + n)
+    return TRUE;
+
+  codewords = (limit - len - (n - 1)) / n + 1;
+
+  /* The dual vectors, truncated to the taps of the dual polynomials */
+  ALLOCATE_MANY(checks, candidate->h_count * blocks, uint64_t);
+  for (i = 0; i < candidate->h_count; ++i)
+    for (j = 0; j < len; ++j)
+      checks[i * blocks + GF2_MATRIX_ROW_BLOCK(j)] |=
+          (uint64_t) cccrack_duals_get(candidate->duals, i, j)
+          << GF2_MATRIX_ROW_SHIFT(j);
+
+  threads = MIN(
+      cccrack_get_inner_threads(self),
+      MAX(1, codewords / CCCRACK_VERIFY_MIN_CHUNK));
+
+  ALLOCATE_MANY(jobs, threads, struct cccrack_verify_job);
+
+  for (i = 0; i < threads; ++i) {
+    jobs[i].candidate = candidate;
+    jobs[i].checks    = checks;
+    jobs[i].blocks    = blocks;
+    jobs[i].packed    = capture->packed;
+    jobs[i].first     = codewords * i / threads;
+    jobs[i].count     = codewords * (i + 1) / threads - jobs[i].first;
+    ALLOCATE_MANY(jobs[i].violations, n, uint64_t);
+  }
+
+  TRY(cccrack_helper_fork_join(
+      jobs,
+      sizeof(struct cccrack_verify_job),
+      threads,
+      cccrack_verify_job_thread));
+
+  for (phase = 0; phase < n; ++phase) {
+    violations = 0;
+    for (i = 0; i < threads; ++i)
+      violations += jobs[i].violations[phase];
+
+    if (phase == 0 || violations < best)
+      best = violations;
+  }
+
+  *rate = (float) best / (codewords * candidate->h_count);
+
+  ok = TRUE;
+
+fail:
+  if (jobs != NULL) {
+    for (i = 0; i < threads; ++i)
+      if (jobs[i].violations != NULL)
+        free(jobs[i].violations);
+
+    free(jobs);
+  }
+
+  if (checks != NULL)
+    free(checks);
+
+  return ok;
+}
+
+/* Candidates failing too many checks are not likely */
+static BOOL
+cccrack_verify(
+    cccrack_t *self,
+    cccrack_rankdef_t *candidate,
+    const struct cccrack_capture *capture)
+{
+  if (capture == NULL || self->params.verify <= 0)
+    return TRUE;
+
+  TRY(cccrack_verify_candidate(
+      self,
+      candidate,
+      capture,
+      &candidate->violation_rate));
+
+  if (candidate->violation_rate > self->params.verify_max_rate)
+    candidate->likely = FALSE;
+
+  return TRUE;
+
+fail:
+  return FALSE;
+}
+
+#ifdef CCCRACK_CHECKS
+/* The matrix method must agree on whether this configuration is likely */
+static void
+cccrack_check_poly_decision(const cccrack_rankdef_t *template, BOOL likely)
+{
+  gf2_matrix_t *G = NULL;
+
+  if (!cccrack_rankdef_solve(template, 1, &G)) {
+    WARNING("Check: cannot solve the system of n = %u, K = %u\n",
+        template->n,
+        template->K);
+    return;
+  }
+
+  if ((G->rows == template->k) != likely)
+    WARNING(
+        "Check: polynomial method says %s, matrix method finds %u "
+        "generator(s) (n = %u, K = %u)\n",
+        likely ? "likely" : "unlikely",
+        G->rows,
+        template->n,
+        template->K);
+
+  gf2_matrix_destroy(G);
+}
+#endif /* CCCRACK_CHECKS */
+
+/*
+ * For rate 1/n codes with n - 1 duals, the generator is the primitive
+ * kernel vector of the polynomial form of H, given by its maximal
+ * minors. This is exact polynomial arithmetic and needs no linear
+ * system. The candidate is likely only if the generator has exactly
+ * K taps; otherwise it is left to the matrix method (which also reports
+ * multiple solutions) if all candidates were requested.
+ */
+static BOOL
+cccrack_eval_candidate_poly(
+    cccrack_t *self,
+    const cccrack_rankdef_t *template,
+    const struct cccrack_capture *capture,
+    BOOL *done)
+{
+  const struct cccrack_duals *duals = template->duals;
+  unsigned int n = template->n;
+  unsigned int K = template->K;
+  gf2_poly_t **h = NULL;
+  gf2_poly_t **g = NULL;
+  cccrack_rankdef_t *candidate = NULL;
+  cccrack_rankdef_t *found;
+  unsigned int i, j, t;
+  int degree = -1;
+  BOOL ok = FALSE;
+
+  *done = FALSE;
+
+  if (template->k != 1 || duals->count != n - 1)
+    return TRUE;
+
+  ALLOCATE_MANY(h, (n - 1) * n, gf2_poly_t *);
+  ALLOCATE_MANY(g, n, gf2_poly_t *);
+
+  for (i = 0; i < n - 1; ++i)
+    for (j = 0; j < n; ++j) {
+      CONSTRUCT(h[i * n + j], gf2_poly);
+      for (t = 0; t <= template->muT; ++t)
+        TRY(gf2_poly_set_coef(
+            h[i * n + j],
+            t,
+            cccrack_duals_get(duals, i, n * t + j)));
+    }
+
+  for (j = 0; j < n; ++j)
+    CONSTRUCT(g[j], gf2_poly);
+
+  TRY(gf2_poly_kernel(g, h, n));
+
+  for (j = 0; j < n; ++j)
+    degree = MAX(degree, gf2_poly_get_degree(g[j]));
+
+#ifdef CCCRACK_CHECKS
+  cccrack_check_poly_decision(template, degree == (int) K - 1);
+#endif /* CCCRACK_CHECKS */
+
+  if (degree != (int) K - 1) {
+    *done = !self->params.all;
+    ok = TRUE;
+    goto fail;
+  }
+
+  TRY(candidate = cccrack_rankdef_derive(template, 1));
+
+  cccrack_rankdef_extract_duals(candidate);
+
+  for (j = 0; j < n; ++j) {
+    candidate->g_poly[j] = gf2_poly_get_word(g[j]);
+    for (t = 0; t < K; ++t)
+      if (gf2_poly_get_coef(g[j], K - t - 1))
+        candidate->g[GF2_MATRIX_ROW_BLOCK(n * t + j)] |=
+            1ull << GF2_MATRIX_ROW_SHIFT(n * t + j);
+  }
+
+  candidate->likely = TRUE;
+
+  TRY(cccrack_verify(self, candidate, capture));
+
+  if (self->params.all || cccrack_rankdef_is_likely(candidate)) {
+    TRY(cccrack_decode(self, candidate, capture));
+
+    found = candidate;
+    candidate = NULL;
+    TRY(cccrack_push_rankdef(self, found));
+  }
+
+  *done = TRUE;
+  ok = TRUE;
+
+fail:
+  if (candidate != NULL)
+    cccrack_rankdef_destroy(candidate);
+
+  if (h != NULL) {
+    for (i = 0; i < (n - 1) * n; ++i)
+      if (h[i] != NULL)
+        gf2_poly_destroy(h[i]);
+    free(h);
+  }
+
+  if (g != NULL) {
+    for (j = 0; j < n; ++j)
+      if (g[j] != NULL)
+        gf2_poly_destroy(g[j]);
+    free(g);
+  }
+
+  return ok;
+}
+
+/* cache and capture may be NULL */
+static BOOL
+cccrack_eval_candidate(
+    cccrack_t *self,
+    const cccrack_rankdef_t *template,
+    const struct cccrack_capture *capture,
+    struct cccrack_solve_cache *cache)
+{
+  const struct cccrack_solve_cache_entry *entry = NULL;
+  cccrack_rankdef_t *candidate = NULL;
+  cccrack_rankdef_t *found;
+  const gf2_matrix_t *G;
+  gf2_matrix_t *G_new = NULL;
+  BOOL should_save;
+  BOOL done;
+  BOOL ok = FALSE;
+
+  /*
+   * Candidates keep their polynomials in 64-bit words, both to report them
+   * and to decode them. Longer codes cannot be represented: skip them
+   * rather than truncating their taps.
+   */
+  if (template->K > CCCRACK_MAX_CONSTRAINT
+      || template->muT >= CCCRACK_MAX_CONSTRAINT)
+    return TRUE;
+
+  TRY(cccrack_eval_candidate_poly(self, template, capture, &done));
+  if (done)
+    return TRUE;
+
+  if (cache != NULL)
+    entry = cccrack_solve_cache_lookup(cache, template);
+
+  if (entry == NULL) {
+    TRY(cccrack_rankdef_solve(
+        template,
+        cccrack_get_inner_threads(self),
+        &G_new));
+
+    if (cache != NULL) {
+      entry = cccrack_solve_cache_insert(cache, template, G_new);
+      G_new = NULL;
+    }
+  }
+
+  G = entry != NULL ? entry->G : G_new;
+
+  TRY(candidate = cccrack_rankdef_derive(template, gf2_matrix_get_rows(G)));
+
+  cccrack_rankdef_extract_duals(candidate);
+  cccrack_rankdef_extract_generators(candidate, G);
+
+  TRY(cccrack_verify(self, candidate, capture));
+
+  should_save =
+      (self->params.all || cccrack_rankdef_is_likely(candidate));
+
+  if (should_save) {
+    TRY(cccrack_decode(self, candidate, capture));
+
+    found = candidate;
+    candidate = NULL;
+    TRY(cccrack_push_rankdef(self, found));
+  }
+
+  ok = TRUE;
+
+fail:
+  if (candidate != NULL)
+    cccrack_rankdef_destroy(candidate);
+
+  if (G_new != NULL)
+    gf2_matrix_destroy(G_new);
+
+  return ok;
+}
+
+static BOOL
+cccrack_enumerate_configs(
+    cccrack_t *self,
+    cccrack_rankdef_t *template,
+    const struct cccrack_capture *capture)
+{
+  struct cccrack_solve_cache cache;
+  unsigned int k, n, n_a, n_k;
+  unsigned int z;
+  BOOL ok = FALSE;
+
+  memset(&cache, 0, sizeof(struct cccrack_solve_cache));
+
+  /*
+   * Now we have n_a and n. We are ready to enumerate all
+   * possible values for k and muT
+   */
+
+  n   = template->n;
+  n_a = template->n_a;
+
+  for (k = 1; k < n; ++k) {
+    n_k = n - k;
+    for (z = 1; z <= n_k; ++z) {
+      template->muT = template->n_a  - (template->n_a * k) / n - z;
+      template->k = k;
+      template->K = template->muT / template->k + 1;
+
+      /* This is something interesting. Study case when K = 1 */
+      if (template->K > 1)
+        TRY(cccrack_eval_candidate(self, template, capture, &cache));
+    }
+  }
+
+  ok = TRUE;
+
+fail:
+  cccrack_solve_cache_finalize(&cache);
+
+  return ok;
+}
+
+/* We have guessed n now. How about k and K? */
+static BOOL
+cccrack_eval_template(
+    cccrack_t *self,
+    cccrack_rankdef_t *rankdef,
+    const struct cccrack_capture *capture)
+{
+  BOOL have_kays = self->params.k > 0 && self->params.K > 0;
+
+  if (have_kays) {
+    rankdef->k = self->params.k;
+    rankdef->K = self->params.K;
+    rankdef->muT = rankdef->k * (rankdef->K - 1);
+
+    return cccrack_eval_candidate(self, rankdef, capture, NULL);
+  }
+
+  /* No k, K provided. Test them all */
+  return cccrack_enumerate_configs(self, rankdef, capture);
+}
+
+static uint64_t
+cccrack_row_reliability(
+    const cccrack_t *self,
+    const uint8_t *rel,
+    uint64_t first,
+    unsigned int l)
+{
+  unsigned int bps = self->symtag->tagging.bps;
+  uint64_t last = first + l;
+  uint64_t p;
+  uint64_t result;
+
+  if (self->params.soft_metric == CCCRACK_SOFT_METRIC_SUM) {
+    result = 0;
+    for (p = first; p < last; ++p)
+      result += rel[p / bps];
+  } else {
+    result = rel[first / bps];
+    for (p = first / bps + 1; p <= (last - 1) / bps; ++p)
+      if (rel[p] < result)
+        result = rel[p];
+  }
+
+  return result;
+}
+
+/* The `height' most reliable l-bit rows starting at bit `start' */
+static uint64_t *
+cccrack_select_rows(
+    const cccrack_t *self,
+    const uint8_t *rel,
+    uint64_t start,
+    uint64_t rows,
+    unsigned int l,
+    unsigned int height)
+{
+  uint64_t *rowsel = NULL;
+  uint64_t i;
+  topk_t *topk = NULL;
+
+  CONSTRUCT(topk, topk, height);
+
+  for (i = 0; i < rows; ++i)
+    topk_push(topk, cccrack_row_reliability(self, rel, start + i * l, l), i);
+
+  topk_sort_by_index(topk);
+
+  ALLOCATE_MANY(rowsel, height, uint64_t);
+
+  for (i = 0; i < topk_get_size(topk); ++i)
+    rowsel[i] = topk_get_index(topk, i);
+
+fail:
+  if (topk != NULL)
+    topk_destroy(topk);
+
+  return rowsel;
+}
+
+/*
+ * The code matrix is made of rows taken from the grid of consecutive
+ * l-bit words starting at bit 0. If we have soft information, pick the
+ * `height' most reliable rows of the whole capture. These depend only
+ * on the capture, so they are computed once for every width.
+ */
+static const uint64_t *
+cccrack_get_row_selection_unlocked(
+    cccrack_t *self,
+    unsigned int l,
+    unsigned int height)
+{
+  const uint8_t *rel = symtag_get_reliabilities(self->symtag);
+
+  if (rel == NULL)
+    return NULL;
+
+  if (self->rowsel[l] == NULL)
+    self->rowsel[l] = cccrack_select_rows(
+        self,
+        rel,
+        0,
+        self->symtag->bit_len / l,
+        l,
+        height);
+
+  return self->rowsel[l];
+}
+
+static const uint64_t *
+cccrack_get_row_selection(
+    cccrack_t *self,
+    unsigned int l,
+    unsigned int height)
+{
+  const uint64_t *rowsel;
+
+  pthread_mutex_lock(&self->lock);
+  rowsel = cccrack_get_row_selection_unlocked(self, l, height);
+  pthread_mutex_unlock(&self->lock);
+
+  return rowsel;
+}
+
+/*
+ * Without soft information, rows may be sampled from the whole region
+ * instead of its beginning. The rows of the l-bit grid are split in
+ * `height' strata and one random row is taken from each, so rows come
+ * out sorted and distinct. The same seed, region and width always give
+ * the same rows.
+ */
+static uint64_t *
+cccrack_sample_rows(
+    const cccrack_t *self,
+    const struct cccrack_region *region,
+    unsigned int l,
+    unsigned int height)
+{
+  uint64_t rows = region->len / l;
+  uint64_t state = self->params.seed ^ (region->start << 16) ^ l;
+  uint64_t *rowsel = NULL;
+  uint64_t i, first, last;
+
+  ALLOCATE_MANY(rowsel, height, uint64_t);
+
+  for (i = 0; i < height; ++i) {
+    first = rows * i / height;
+    last  = rows * (i + 1) / height;
+    rowsel[i] = first + splitmix64_next(&state) % (last - first);
+  }
+
+fail:
+  return rowsel;
+}
+
+/*
+ * Regions other than the whole capture pick their own rows, as the
+ * cached selection may fall anywhere in the capture.
+ */
+static BOOL
+cccrack_get_window_rows(
+    cccrack_t *self,
+    const struct cccrack_region *region,
+    unsigned int l,
+    unsigned int height,
+    const uint64_t **rowsel,
+    uint64_t **own)
+{
+  const uint8_t *rel = symtag_get_reliabilities(self->symtag);
+
+  *rowsel = NULL;
+  *own = NULL;
+
+  if (rel == NULL) {
+    if (self->params.sample)
+      TRY(*rowsel = *own = cccrack_sample_rows(self, region, l, height));
+
+    return TRUE;
+  }
+
+  if (region->start == 0 && region->len == self->symtag->bit_len) {
+    TRY(*rowsel = cccrack_get_row_selection(self, l, height));
+  } else {
+    TRY(*rowsel = *own = cccrack_select_rows(
+        self,
+        rel,
+        region->start,
+        region->len / l,
+        l,
+        height));
+  }
+
+  return TRUE;
+
+fail:
+  return FALSE;
+}
+
+/* Rows are contiguous in the packed capture, so we copy whole words */
+static void
+cccrack_fill_window(
+    gf2_matrix_t *R,
+    const uint64_t *packed,
+    const struct cccrack_region *region,
+    const uint64_t *rowsel)
+{
+  unsigned int l = gf2_matrix_get_cols(R);
+  unsigned int height = gf2_matrix_get_rows(R);
+  unsigned int i;
+
+  for (i = 0; i < height; ++i)
+    gf2_matrix_load_row(
+        R,
+        i,
+        packed,
+        region->start + (rowsel == NULL ? i : rowsel[i]) * l);
+}
+
+/*
+ * First stage of the cascade. Rows of windows up to 128 bits wide fit
+ * in two words, so the rank is found by inserting them into a basis
+ * indexed by leading bit, with no matrix. Windows with no deficiency
+ * usually reach full rank after a few more rows than columns, and we
+ * stop there. The result is exact: the elimination of the whole window
+ * has full rank if and only if this does.
+ */
+static unsigned int
+cccrack_probe_rank(
+    const uint64_t *packed,
+    const struct cccrack_region *region,
+    const uint64_t *rowsel,
+    unsigned int l,
+    unsigned int height)
+{
+  uint64_t basis[CCCRACK_PROBE_MAX_WIDTH][2];
+  uint64_t mask[2];
+  uint64_t v[2], p;
+  unsigned int i, lead, rank = 0;
+
+  mask[0] = l >= 64 ? ~0ull : (1ull << l) - 1;
+  mask[1] = l >= 128 ? ~0ull : l > 64 ? (1ull << (l - 64)) - 1 : 0;
+
+  for (i = 0; i < l; ++i)
+    basis[i][0] = basis[i][1] = 0;
+
+  for (i = 0; i < height && rank < l; ++i) {
+    p = region->start + (rowsel == NULL ? i : rowsel[i]) * l;
+
+    v[0] = symtag_packed_get_word(packed, p) & mask[0];
+    v[1] = l > 64 ? symtag_packed_get_word(packed, p + 64) & mask[1] : 0;
+
+    while (v[0] != 0 || v[1] != 0) {
+      lead = v[1] != 0
+          ? 127 - __builtin_clzll(v[1])
+          : 63 - __builtin_clzll(v[0]);
+
+      if (basis[lead][0] == 0 && basis[lead][1] == 0) {
+        basis[lead][0] = v[0];
+        basis[lead][1] = v[1];
+        ++rank;
+        break;
+      }
+
+      v[0] ^= basis[lead][0];
+      v[1] ^= basis[lead][1];
+    }
+  }
+
+  return rank;
+}
+
+/***************************** Period estimation ****************************/
+/*
+ * Words of a convolutional code taken at the right phase of its period
+ * satisfy the parity checks, which show up as a large coefficient of
+ * the Walsh-Hadamard transform of their histogram. The transform is
+ * done in place. Butterflies at least CCCRACK_PERIOD_LANES apart run on
+ * GCC vectors, as in the Viterbi decoder.
+ */
+#define CCCRACK_PERIOD_LANES 8
+
+typedef int16_t cccrack_period_vec_t
+    __attribute__((vector_size(2 * CCCRACK_PERIOD_LANES), aligned(2)));
+
+static void
+cccrack_period_fwht(int16_t *spectrum)
+{
+  cccrack_period_vec_t *va, *vb, a_vec;
+  unsigned int h, i, j;
+  int16_t a, b;
+
+  for (h = 1; h < CCCRACK_PERIOD_LANES; h <<= 1)
+    for (i = 0; i < (1u << CCCRACK_PERIOD_WORD_BITS); i += h << 1)
+      for (j = i; j < i + h; ++j) {
+        a = spectrum[j];
+        b = spectrum[j + h];
+        spectrum[j]     = a + b;
+        spectrum[j + h] = a - b;
+      }
+
+  for (; h < (1u << CCCRACK_PERIOD_WORD_BITS); h <<= 1)
+    for (i = 0; i < (1u << CCCRACK_PERIOD_WORD_BITS); i += h << 1)
+      for (j = i; j < i + h; j += CCCRACK_PERIOD_LANES) {
+        va = (cccrack_period_vec_t *) (spectrum + j);
+        vb = (cccrack_period_vec_t *) (spectrum + j + h);
+        a_vec = *va;
+        *va = a_vec + *vb;
+        *vb = a_vec - *vb;
+      }
+}
+
+/* Largest bias of a nonzero parity mask, for words at phase mod p */
+static float
+cccrack_period_bias(
+    int16_t *spectrum,
+    const struct cccrack_capture *capture,
+    unsigned int p,
+    unsigned int phase)
+{
+  uint64_t words = (capture->len - CCCRACK_PERIOD_WORD_BITS - phase) / p;
+  uint64_t count = MIN(words, CCCRACK_PERIOD_SAMPLES);
+  uint64_t i, pos;
+  unsigned int mask = (1u << CCCRACK_PERIOD_WORD_BITS) - 1;
+  int peak = 0;
+
+  memset(spectrum, 0, sizeof(int16_t) << CCCRACK_PERIOD_WORD_BITS);
+
+  /*
+   * Consecutive words from the middle of the capture. Spreading them
+   * with a stride could align them to n by accident.
+   */
+  pos = phase + (words - count) / 2 * p;
+  for (i = 0; i < count; ++i, pos += p)
+    ++spectrum[symtag_packed_get_word(capture->packed, pos) & mask];
+
+  cccrack_period_fwht(spectrum);
+
+  for (i = 1; i <= mask; ++i)
+    if (abs(spectrum[i]) > peak)
+      peak = abs(spectrum[i]);
+
+  return (float) peak / count;
+}
+
+/*
+ * Biases seen with p = 1 are not periodic (e.g. unbalanced streams)
+ * and are discounted. Multiples of n are biased too, so the smallest
+ * biased period wins. A period of 0 means no guess.
+ *
+ * Words at the right phase of n are at least 1 / CCCRACK_PERIOD_MAX of
+ * all words, so a code with short enough parity checks always biases
+ * p = 1 too. Wrong taggings show no bias there, and cost a single
+ * transform.
+ */
+static BOOL
+cccrack_estimate_period(
+    const struct cccrack_capture *capture,
+    unsigned int *period)
+{
+  int16_t *spectrum = NULL;
+  unsigned int p, phase;
+  float base, best;
+
+  *period = 0;
+
+  if (capture->len / CCCRACK_PERIOD_MAX
+      < CCCRACK_PERIOD_MIN_SAMPLES + CCCRACK_PERIOD_WORD_BITS)
+    return TRUE;
+
+  ALLOCATE_MANY(spectrum, 1u << CCCRACK_PERIOD_WORD_BITS, int16_t);
+
+  base = cccrack_period_bias(spectrum, capture, 1, 0);
+
+  for (p = 2;
+      base >= CCCRACK_PERIOD_NO_BIAS && *period == 0 && p <= CCCRACK_PERIOD_MAX;
+      ++p) {
+    best = 0;
+    for (phase = 0; phase < p && best - base < CCCRACK_PERIOD_MIN_BIAS; ++phase)
+      best = MAX(best, cccrack_period_bias(spectrum, capture, p, phase));
+
+    if (best - base >= CCCRACK_PERIOD_MIN_BIAS)
+      *period = p;
+  }
+
+  free(spectrum);
+
+  return TRUE;
+
+fail:
+  return FALSE;
+}
+
+/***************************** Region analysis ******************************/
+static unsigned int
+cccrack_region_get_width(
+    const cccrack_t *self,
+    const struct cccrack_region *region)
+{
+  unsigned int width = floor(sqrt(region->len));
+
+  return MIN(width, cccrack_get_max_width(self));
+}
+
+/*
+ * Rows of the l-bit window. Each thread may hold a window and its
+ * transformation matrix at a time, which must fit the memory budget.
+ * Returns 0 if not even a square window does.
+ */
+static unsigned int
+cccrack_region_get_height(
+    const cccrack_t *self,
+    const struct cccrack_region *region,
+    unsigned int l)
+{
+  unsigned int width = cccrack_region_get_width(self, region);
+  uint64_t row_size = GF2_MATRIX_ROW_BLOCKS(l) * sizeof(uint64_t);
+  uint64_t height;
+  uint64_t rows;
+
+  height = region->len / l;
+  if (height > width * cccrack_get_max_rel_height(self))
+    height = width * cccrack_get_max_rel_height(self);
+
+  if (self->params.memory_budget > 0) {
+    rows = self->params.memory_budget / self->params.threads / row_size;
+    rows = rows > l ? rows - l : 0;
+    if (height > rows)
+      height = rows;
+  }
+
+  return height >= l ? height : 0;
+}
+
+/* Rank of the first `height' rows of the window, without the duals */
+static BOOL
+cccrack_region_get_rank(
+    const cccrack_t *self,
+    const struct cccrack_region *region,
+    const struct cccrack_capture *capture,
+    const uint64_t *rowsel,
+    unsigned int l,
+    unsigned int height,
+    unsigned int *rank)
+{
+  gf2_matrix_t *R = NULL;
+
+  if (l <= CCCRACK_PROBE_MAX_WIDTH) {
+    *rank = cccrack_probe_rank(capture->packed, region, rowsel, l, height);
+    return TRUE;
+  }
+
+  CONSTRUCT(R, gf2_matrix, height, l, self->params.hugepages);
+
+  cccrack_fill_window(R, capture->packed, region, rowsel);
+
+  TRY(gf2_matrix_gauss_jordan_cols(R, NULL));
+
+  *rank = gf2_matrix_get_rank(R);
+
+  gf2_matrix_destroy(R);
+
+  return TRUE;
+
+fail:
+  if (R != NULL)
+    gf2_matrix_destroy(R);
+
+  return FALSE;
+}
+
+/*
+ * Adaptive height: start with twice as many rows as columns, and keep
+ * doubling until the window has full rank or its rank stops growing.
+ */
+static BOOL
+cccrack_region_settle_height(
+    const cccrack_t *self,
+    const struct cccrack_region *region,
+    const struct cccrack_capture *capture,
+    const uint64_t *rowsel,
+    unsigned int l,
+    unsigned int *height,
+    unsigned int *rank)
+{
+  unsigned int h = MIN(*height, 2 * l);
+  unsigned int next, next_rank;
+
+  TRY(cccrack_region_get_rank(self, region, capture, rowsel, l, h, rank));
+
+  while (*rank < l && h < *height) {
+    next = MIN(2 * h, *height);
+
+    TRY(cccrack_region_get_rank(
+        self,
+        region,
+        capture,
+        rowsel,
+        l,
+        next,
+        &next_rank));
+
+    h = next;
+
+    if (next_rank == *rank)
+      break;
+
+    *rank = next_rank;
+  }
+
+  *height = h;
+
+  return TRUE;
+
+fail:
+  return FALSE;
+}
+
+/*
+ * Tell whether the l-bit window of the region is rank deficient. The
+ * full elimination only runs when the dual vectors are needed, or when
+ * the probe cannot decide and the sketch finds the window deficient. It
+ * may use up to `threads' threads.
+ */
+static BOOL
+cccrack_region_probe(
+    cccrack_t *self,
+    const struct cccrack_region *region,
+    const struct cccrack_capture *capture,
+    unsigned int l,
+    unsigned int threads,
+    BOOL *deficient,
+    struct cccrack_duals **duals)
+{
+  unsigned int height = cccrack_region_get_height(self, region, l);
+  unsigned int rank;
+  const uint64_t *rowsel = NULL;
+  uint64_t *own = NULL;
+  gf2_matrix_t *R = NULL;
+  gf2_matrix_t *B = NULL;
+  BOOL ok = FALSE;
+
+  *deficient = FALSE;
+
+  if (height == 0)
+    return TRUE;
+
+  TRY(cccrack_get_window_rows(self, region, l, height, &rowsel, &own));
+
+  if (self->params.adaptive) {
+    TRY(cccrack_region_settle_height(
+        self,
+        region,
+        capture,
+        rowsel,
+        l,
+        &height,
+        &rank));
+
+    *deficient = rank < l;
+
+    if (!*deficient || duals == NULL) {
+      ok = TRUE;
+      goto fail;
+    }
+  } else if (l <= CCCRACK_PROBE_MAX_WIDTH) {
+    *deficient =
+        cccrack_probe_rank(capture->packed, region, rowsel, l, height) < l;
+
+    if (!*deficient || duals == NULL) {
+      ok = TRUE;
+      goto fail;
+    }
+  }
+
+  /* Construct received code matrix */
+  CONSTRUCT(R, gf2_matrix, height, l, self->params.hugepages);
+
+  cccrack_fill_window(R, capture->packed, region, rowsel);
+
+  /* Too wide for the probe: let a sketch rule out full rank windows */
+  if (!self->params.adaptive && l > CCCRACK_PROBE_MAX_WIDTH) {
+    TRY(gf2_matrix_sketch_is_deficient(
+        R,
+        CCCRACK_SKETCH_OVERSAMPLE,
+        self->params.seed ^ (region->start << 16) ^ l,
+        deficient));
+
+    if (!*deficient) {
+      ok = TRUE;
+      goto fail;
+    }
+  }
+
+  TRY(gf2_matrix_gauss_jordan_cols_mt(R, &B, threads));
+
+  *deficient = gf2_matrix_get_rank(R) < l;
+
+  if (*deficient && duals != NULL)
+    TRY(*duals = cccrack_duals_from_matrices(R, B));
+
+  ok = TRUE;
+
+fail:
+  if (own != NULL)
+    free(own);
+
+  if (B != NULL)
+    gf2_matrix_destroy(B);
+
+  if (R != NULL)
+    gf2_matrix_destroy(R);
+
+  return ok;
+}
+
+/*
+ * Widths worth trying in the sweep. As n cannot exceed the first
+ * deficient width, the adaptive mode stops at twice that one.
+ */
+static unsigned int
+cccrack_region_get_limit(
+    const cccrack_t *self,
+    const struct cccrack_region *region,
+    unsigned int first)
+{
+  unsigned int width = cccrack_region_get_width(self, region);
+
+  if (self->params.adaptive && first > 0)
+    width = MIN(width, 2 * first + 1);
+
+  return width;
+}
+
+/* Sweep multiples of step until the deficiencies we need are found */
+static BOOL
+cccrack_region_sweep(
+    cccrack_t *self,
+    struct cccrack_region *region,
+    const struct cccrack_capture *capture,
+    unsigned int step)
+{
+  unsigned int l;
+  BOOL deficient;
+
+  for (l = MAX(2, step);
+      region->second == 0
+      && l < cccrack_region_get_limit(self, region, region->first)
+      && cccrack_region_get_height(self, region, l) > 0
+      && !cccrack_out_of_time(self);
+      l += step) {
+    TRY(cccrack_region_probe(
+        self,
+        region,
+        capture,
+        l,
+        1,
+        &deficient,
+        region->first == 0 ? &region->duals : NULL));
+
+    if (deficient) {
+      if (region->first == 0) {
+        region->first = l;
+        if (self->params.n > 0)
+          break;
+      } else {
+        region->second = l;
+      }
+    }
+  }
+
+  return TRUE;
+
+fail:
+  return FALSE;
+}
+
+/*
+ * Parallel sweep. Widths are handed out in increasing order. Once the
+ * deficiencies we need are found, no larger width can change the
+ * outcome, so workers stop there. Results are then read in width order,
+ * which gives the same deficiencies as the serial sweep. Workers that
+ * run out of widths lend themselves to the eliminations still running.
+ */
+enum cccrack_sweep_state {
+  CCCRACK_SWEEP_PENDING,
+  CCCRACK_SWEEP_FULL,
+  CCCRACK_SWEEP_DEFICIENT
+};
+
+struct cccrack_sweep {
+  cccrack_t *self;
+  const struct cccrack_region *region;
+  const struct cccrack_capture *capture;
+  unsigned int step;
+  unsigned int width;
+  unsigned int needed; /* Deficient widths to find */
+
+  pthread_mutex_t lock;
+  unsigned int next;   /* Next width to probe */
+  unsigned int limit;  /* No width above this one is needed */
+  unsigned int first;  /* Smallest deficient width so far */
+  uint8_t *state;      /* Per width */
+  struct cccrack_duals **duals; /* Per width, if it could be the first */
+  unsigned int spare;  /* Workers out of widths, lent to eliminations */
+  BOOL failed;
+};
+
+/* Called with the lock held */
+static void
+cccrack_sweep_update_limit(struct cccrack_sweep *self)
+{
+  unsigned int l, count = 0;
+
+  if (self->self->params.adaptive && 2 * self->first < self->limit)
+    self->limit = 2 * self->first;
+
+  for (l = MAX(2, self->step); l < self->limit; l += self->step)
+    if (self->state[l] == CCCRACK_SWEEP_DEFICIENT && ++count == self->needed) {
+      self->limit = l;
+      break;
+    }
+}
+
+static void
+cccrack_sweep_run(struct cccrack_sweep *self)
+{
+  struct cccrack_duals *duals;
+  unsigned int l, extra;
+  BOOL want_duals;
+  BOOL deficient;
+  BOOL ok;
+
+  for (;;) {
+    pthread_mutex_lock(&self->lock);
+    l = self->next;
+    if (self->failed
+        || l >= self->width
+        || l > self->limit
+        || cccrack_region_get_height(self->self, self->region, l) == 0
+        || cccrack_out_of_time(self->self)) {
+      ++self->spare;
+      pthread_mutex_unlock(&self->lock);
+      break;
+    }
+    self->next += self->step;
+    want_duals = l < self->first;
+
+    /* The widest windows come last, when workers start to run out */
+    extra = self->spare;
+    self->spare = 0;
+    pthread_mutex_unlock(&self->lock);
+
+    duals = NULL;
+    ok = cccrack_region_probe(
+        self->self,
+        self->region,
+        self->capture,
+        l,
+        1 + extra,
+        &deficient,
+        want_duals ? &duals : NULL);
+
+    pthread_mutex_lock(&self->lock);
+    self->spare += extra;
+    if (!ok) {
+      self->failed = TRUE;
+    } else {
+      self->state[l] = deficient
+          ? CCCRACK_SWEEP_DEFICIENT
+          : CCCRACK_SWEEP_FULL;
+      self->duals[l] = duals;
+
+      if (deficient) {
+        if (l < self->first)
+          self->first = l;
+        cccrack_sweep_update_limit(self);
+      }
+    }
+    pthread_mutex_unlock(&self->lock);
+  }
+}
+
+static void *
+cccrack_sweep_thread(void *data)
+{
+  cccrack_sweep_run((struct cccrack_sweep *) data);
+
+  return NULL;
+}
+
+static BOOL
+cccrack_region_sweep_parallel(
+    cccrack_t *self,
+    struct cccrack_region *region,
+    const struct cccrack_capture *capture,
+    unsigned int step,
+    unsigned int threads)
+{
+  struct cccrack_sweep sweep;
+  unsigned int width = cccrack_region_get_width(self, region);
+  unsigned int l;
+  BOOL have_lock = FALSE;
+  BOOL ok = FALSE;
+
+  memset(&sweep, 0, sizeof(struct cccrack_sweep));
+
+  sweep.self    = self;
+  sweep.region  = region;
+  sweep.capture = capture;
+  sweep.step    = step;
+  sweep.width   = width;
+  sweep.needed  = self->params.n > 0 ? 1 : 2;
+  sweep.next    = MAX(2, step);
+  sweep.limit   = width;
+  sweep.first   = width;
+
+  ALLOCATE_MANY(sweep.state, width, uint8_t);
+  ALLOCATE_MANY(sweep.duals, width, struct cccrack_duals *);
+
+  TRY(pthread_mutex_init(&sweep.lock, NULL) == 0);
+  have_lock = TRUE;
+
+  /* All workers share the sweep */
+  TRY(cccrack_helper_fork_join(&sweep, 0, threads, cccrack_sweep_thread));
+
+  TRY(!sweep.failed);
+
+  for (l = MAX(2, step); region->second == 0 && l < width; l += step) {
+    if (sweep.state[l] == CCCRACK_SWEEP_PENDING)
+      break;
+
+    if (sweep.state[l] == CCCRACK_SWEEP_DEFICIENT) {
+      if (region->first == 0) {
+        region->first = l;
+        region->duals = sweep.duals[l];
+        sweep.duals[l] = NULL;
+        if (self->params.n > 0)
+          break;
+      } else {
+        region->second = l;
+      }
+    }
+  }
+
+  ok = TRUE;
+
+fail:
+  if (have_lock)
+    pthread_mutex_destroy(&sweep.lock);
+
+  if (sweep.duals != NULL) {
+    for (l = 0; l < width; ++l)
+      if (sweep.duals[l] != NULL)
+        cccrack_duals_release(sweep.duals[l]);
+
+    free(sweep.duals);
+  }
+
+  if (sweep.state != NULL)
+    free(sweep.state);
+
+  return ok;
+}
+
+/* If the period guess leads nowhere, sweep every width */
+static BOOL
+cccrack_region_analyze(
+    cccrack_t *self,
+    struct cccrack_region *region,
+    const struct cccrack_capture *capture,
+    unsigned int threads)
+{
+  if (threads > 1) {
+    TRY(cccrack_region_sweep_parallel(
+        self,
+        region,
+        capture,
+        region->step,
+        threads));
+  } else {
+    TRY(cccrack_region_sweep(self, region, capture, region->step));
+  }
+
+  if (region->step > 1
+      && (region->first == 0 || (self->params.n == 0 && region->second == 0))) {
+    if (region->duals != NULL) {
+      cccrack_duals_release(region->duals);
+      region->duals = NULL;
+    }
+
+    region->first = region->second = 0;
+
+    if (threads > 1) {
+      TRY(cccrack_region_sweep_parallel(self, region, capture, 1, threads));
+    } else {
+      TRY(cccrack_region_sweep(self, region, capture, 1));
+    }
+  }
+
+  return TRUE;
+
+fail:
+  return FALSE;
+}
+
+struct cccrack_region_job {
+  cccrack_t *self;
+  const struct cccrack_capture *capture;
+  struct cccrack_region *region_list;
+  unsigned int region_count;
+  unsigned int first;
+  unsigned int stride;
+  unsigned int threads; /* For the width sweep of each region */
+  BOOL ok;
+};
+
+static void
+cccrack_region_job_run(struct cccrack_region_job *self)
+{
+  unsigned int i;
+
+  for (i = self->first; i < self->region_count; i += self->stride)
+    TRY(cccrack_region_analyze(
+        self->self,
+        self->region_list + i,
+        self->capture,
+        self->threads));
+
+  self->ok = TRUE;
+
+fail:
+  return;
+}
+
+static void *
+cccrack_region_job_thread(void *data)
+{
+  cccrack_region_job_run((struct cccrack_region_job *) data);
+
+  return NULL;
+}
+
+static BOOL
+cccrack_analyze_regions(
+    cccrack_t *self,
+    struct cccrack_region *region_list,
+    unsigned int region_count,
+    const struct cccrack_capture *capture)
+{
+  struct cccrack_region_job *jobs = NULL;
+  unsigned int inner = cccrack_get_inner_threads(self);
+  unsigned int threads = MIN(inner, region_count);
+  unsigned int i;
+  BOOL ok = FALSE;
+
+  /* Threads left by the regions sweep their widths */
+
+  ALLOCATE_MANY(jobs, threads, struct cccrack_region_job);
+
+  for (i = 0; i < threads; ++i) {
+    jobs[i].self         = self;
+    jobs[i].capture      = capture;
+    jobs[i].region_list  = region_list;
+    jobs[i].region_count = region_count;
+    jobs[i].first        = i;
+    jobs[i].stride       = threads;
+    jobs[i].threads      = MAX(1, inner / threads);
+  }
+
+  TRY(cccrack_helper_fork_join(
+      jobs,
+      sizeof(struct cccrack_region_job),
+      threads,
+      cccrack_region_job_thread));
+
+  for (i = 0; i < threads; ++i)
+    TRY(jobs[i].ok);
+
+  ok = TRUE;
+
+fail:
+  if (jobs != NULL)
+    free(jobs);
+
+  return ok;
+}
+
+/* Whether both sets of dual vectors span the same subspace */
+static BOOL
+cccrack_duals_same_span(
+    const struct cccrack_duals *a,
+    const struct cccrack_duals *b,
+    BOOL *same)
+{
+  uint64_t *basis = NULL;
+  unsigned int *pivot = NULL;
+  uint64_t *v = NULL;
+  uint64_t *row;
+  unsigned int i, j, k, p;
+  BOOL ok = FALSE;
+
+  *same = FALSE;
+
+  if (a->length != b->length || a->count != b->count)
+    return TRUE;
+
+  *same = a->hash == b->hash
+      && memcmp(a->bits, b->bits, a->count * a->blocks * sizeof(uint64_t)) == 0;
+
+  if (*same)
+    return TRUE;
+
+  ALLOCATE_MANY(basis, a->count * a->blocks, uint64_t);
+  ALLOCATE_MANY(pivot, a->count, unsigned int);
+  ALLOCATE_MANY(v, a->blocks, uint64_t);
+
+  /* Reduce the vectors of a, then check those of b against them */
+  for (i = 0; i < a->count; ++i) {
+    row = basis + i * a->blocks;
+    memcpy(row, a->bits + i * a->blocks, a->blocks * sizeof(uint64_t));
+
+    for (j = 0; j < i; ++j)
+      if ((row[pivot[j] >> 6] >> (pivot[j] & 63)) & 1)
+        for (k = 0; k < a->blocks; ++k)
+          row[k] ^= basis[j * a->blocks + k];
+
+    for (p = 0; p < a->length; ++p)
+      if ((row[p >> 6] >> (p & 63)) & 1)
+        break;
+
+    if (p == a->length)
+      goto done;
+
+    pivot[i] = p;
+
+    for (j = 0; j < i; ++j)
+      if ((basis[j * a->blocks + (p >> 6)] >> (p & 63)) & 1)
+        for (k = 0; k < a->blocks; ++k)
+          basis[j * a->blocks + k] ^= row[k];
+  }
+
+  for (i = 0; i < b->count; ++i) {
+    memcpy(v, b->bits + i * b->blocks, b->blocks * sizeof(uint64_t));
+
+    for (j = 0; j < a->count; ++j)
+      if ((v[pivot[j] >> 6] >> (pivot[j] & 63)) & 1)
+        for (k = 0; k < a->blocks; ++k)
+          v[k] ^= basis[j * a->blocks + k];
+
+    for (k = 0; k < a->blocks; ++k)
+      if (v[k] != 0)
+        goto done;
+  }
+
+  *same = TRUE;
+
+done:
+  ok = TRUE;
+
+fail:
+  if (v != NULL)
+    free(v);
+
+  if (pivot != NULL)
+    free(pivot);
+
+  if (basis != NULL)
+    free(basis);
+
+  return ok;
+}
+
+/*
+ * Majority vote on the deficient widths first. Once n is known, the
+ * agreeing regions are shifted to the phase of the first of them, so
+ * that all see the code the same way, and vote on their dual vectors.
+ * The winning region is -1 if no region found the code.
+ */
+static BOOL
+cccrack_vote_regions(
+    cccrack_t *self,
+    struct cccrack_region *region_list,
+    unsigned int region_count,
+    const struct cccrack_capture *capture,
+    int *winner)
+{
+  unsigned int i, j, n, votes, best_votes = 0;
+  unsigned int phase, shift;
+  int best = -1;
+  BOOL need_second = self->params.n == 0;
+  BOOL deficient;
+  BOOL same;
+  struct cccrack_region *r;
+
+  for (i = 0; i < region_count; ++i) {
+    r = region_list + i;
+    if (r->first == 0 || (need_second && r->second == 0))
+      continue;
+
+    for (votes = 0, j = 0; j < region_count; ++j)
+      if (region_list[j].first == r->first
+          && region_list[j].second == r->second)
+        ++votes;
+
+    if (votes > best_votes) {
+      best_votes = votes;
+      best = i;
+    }
+  }
+
+  *winner = -1;
+
+  if (best == -1)
+    return TRUE;
+
+  n = need_second
+      ? region_list[best].second - region_list[best].first
+      : self->params.n;
+
+  phase = region_list[best].start % n;
+
+  for (i = 0; i < region_count; ++i) {
+    r = region_list + i;
+    shift = (r->start % n + n - phase) % n;
+
+    if (r->first != region_list[best].first
+        || r->second != region_list[best].second
+        || shift == 0)
+      continue;
+
+    if (r->start >= shift) {
+      r->start -= shift;
+    } else {
+      r->start += n - shift;
+      r->len   -= n;
+    }
+
+    cccrack_duals_release(r->duals);
+    r->duals = NULL;
+
+    TRY(cccrack_region_probe(
+        self,
+        r,
+        capture,
+        r->first,
+        cccrack_get_inner_threads(self),
+        &deficient,
+        &r->duals));
+  }
+
+  for (best_votes = 0, i = 0; i < region_count; ++i) {
+    if (region_list[i].first != region_list[best].first
+        || region_list[i].second != region_list[best].second
+        || region_list[i].duals == NULL)
+      continue;
+
+    for (votes = 0, j = 0; j < region_count; ++j) {
+      if (region_list[j].duals == NULL)
+        continue;
+
+      TRY(cccrack_duals_same_span(
+          region_list[i].duals,
+          region_list[j].duals,
+          &same));
+
+      if (same)
+        ++votes;
+    }
+
+    if (votes > best_votes) {
+      best_votes = votes;
+      *winner = i;
+    }
+  }
+
+  return TRUE;
+
+fail:
+  return FALSE;
+}
+
+static BOOL
+cccrack_analyze_tagging(
+    cccrack_t *self,
+    const struct tagging *tagging,
+    const uint64_t *packed,
+    size_t len)
+{
+  struct cccrack_capture capture = {packed, len};
+  struct cccrack_region *region_list = NULL;
+  unsigned int region_count;
+  unsigned int period = 0;
+  unsigned int i;
+  int winner;
+  cccrack_rankdef_t *rankdef = NULL;
+  BOOL ok = FALSE;
+
+  if (self->params.tagging != -1 && self->params.tagging != tagging->tagging_id)
+    return TRUE;
+
+  /* Only a single tagging is dumped, so the file does not depend on -j */
+  if (self->params.dumpfile != NULL && self->params.tagging != -1)
+    TRY(cccrack_helper_save_packed(self->params.dumpfile, packed, len));
+
+  if (!self->params.no_gray && !tagging->is_gray)
+    return TRUE;
+
+  if (cccrack_out_of_time(self))
+    return TRUE;
+
+  region_count = MIN(self->params.regions, len / CCCRACK_MIN_REGION_LEN);
+  if (region_count == 0)
+    region_count = 1;
+
+  ALLOCATE_MANY(region_list, region_count, struct cccrack_region);
+
+  for (i = 0; i < region_count; ++i) {
+    region_list[i].start = len * i / region_count;
+    region_list[i].len   = len * (i + 1) / region_count - region_list[i].start;
+    region_list[i].step  = 1;
+  }
+
+  if (self->params.estimate_n) {
+    TRY(cccrack_estimate_period(&capture, &period));
+
+    if (period > 0)
+      for (i = 0; i < region_count; ++i)
+        region_list[i].step = period;
+  }
+
+  TRY(cccrack_analyze_regions(self, region_list, region_count, &capture));
+  TRY(cccrack_vote_regions(
+      self,
+      region_list,
+      region_count,
+      &capture,
+      &winner));
+
+  if (winner != -1) {
+    TRY(rankdef = cccrack_rankdef_from_duals(
+        tagging,
+        region_list[winner].duals));
+
+    if (self->params.n > 0)
+      rankdef->n = self->params.n;
+    else
+      cccrack_rankdef_set_second_defficiency(
+          rankdef,
+          region_list[winner].second);
+
+    TRY(cccrack_eval_template(self, rankdef, &capture));
+  }
+
+  ok = TRUE;
+
+fail:
+  if (rankdef != NULL)
+    cccrack_rankdef_destroy(rankdef);
+
+  if (region_list != NULL) {
+    for (i = 0; i < region_count; ++i)
+      if (region_list[i].duals != NULL)
+        cccrack_duals_release(region_list[i].duals);
+
+    free(region_list);
+  }
+
+  return ok;
+}
+
+static BOOL
+cccrack_on_tagging(
+    void *private,
+    const struct tagging *tagging,
+    const uint64_t *packed,
+    size_t len)
+{
+  cccrack_t *self = (cccrack_t *) private;
+  BOOL ok;
+
+  ok = cccrack_analyze_tagging(self, tagging, packed, len);
+
+  /* Even if it failed, so that earlier candidates are not held back */
+  return cccrack_finish_tagging(self, tagging->tagging_id) && ok;
+}
+
+int
+cccrack_run(cccrack_t *self)
+{
+  BOOL ok = FALSE;
+
+  if (self->params.time_budget > 0)
+    self->deadline = cccrack_helper_get_time() + self->params.time_budget;
+
+  /* Candidates reach the list or the sink in tagging order */
+  self->ordered = TRUE;
+  self->next_tagging = 0;
+  self->finished_count = 0;
+
+  TRY(symtag_tag(self->symtag));
+
+  ok = TRUE;
+
+fail:
+  self->ordered = FALSE;
+
+  return ok;
+}
+
+static cccrack_t *
+cccrack_alloc(const struct cccrack_params *params)
+{
+  const struct cccrack_params defparams = cccrack_params_INITIALIZER;
+  cccrack_t *self = NULL;
+
+  if (params == NULL)
+    params = &defparams;
+
+  ALLOCATE(self, cccrack_t);
+
+  self->params = *params;
+
+  /* Every job split divides by these */
+  if (self->params.threads == 0)
+    self->params.threads = 1;
+
+  if (self->params.regions == 0)
+    self->params.regions = 1;
+
+  TRY(pthread_mutex_init(&self->lock, NULL) == 0);
+  self->have_lock = TRUE;
+
+  ALLOCATE_MANY(self->rowsel, cccrack_get_max_width(self), uint64_t *);
+
+  if (self->params.unique)
+    TRY(self->index = cccrack_unique_index_new());
+
+  return self;
+
+fail:
+  if (self != NULL)
+    cccrack_destroy(self);
 
-    p = 0;
+  return NULL;
+}
 
-    for (i = 0; i < height; ++i)
-      for (j = 0; j < l; ++j)
-        gf2_matrix_set(R, i, j, bits[p++]);
+int
+cccrack_is_incomplete(const cccrack_t *self)
+{
+  return self->out_of_time;
+}
 
-    TRY(gf2_matrix_gauss_jordan_cols(R, &B));
+uint64_t
+cccrack_get_tagging_count(const cccrack_t *self)
+{
+  return symtag_get_tagging_count(self->symtag);
+}
 
-    if (gf2_matrix_get_rank(R) < j) {
-      have_n = FALSE;
+unsigned int
+cccrack_get_candidate_count(const cccrack_t *self)
+{
+  return self->rankdef_count;
+}
 
-      if (rankdef == NULL) {
-        TRY(rankdef = cccrack_rankdef_from_matrices(tagging, R, B));
+const cccrack_rankdef_t *
+cccrack_get_candidate(const cccrack_t *self, unsigned int i)
+{
+  return self->rankdef_list[i];
+}
 
-        if (self->params.n > 0) {
-          rankdef->n = self->params.n;
-          have_n = TRUE;
-        }
-      } else {
-        /* No n found. This is the second iter */
-        cccrack_rankdef_set_second_defficiency(rankdef, l);
-        have_n = TRUE;
-      }
+unsigned int
+cccrack_get_unique_count(const cccrack_t *self)
+{
+  return self->index != NULL ? self->index->unique_count : 0;
+}
 
-      if (have_n) {
-        /* We have guessed n now. How about k and K? */
-        have_kays = self->params.k > 0 && self->params.K > 0;
+const unsigned int *
+cccrack_get_unique_taggings(
+    const cccrack_t *self,
+    unsigned int i,
+    unsigned int *count)
+{
+  *count = self->index->unique_list[i]->tagging_count;
+
+  return self->index->unique_list[i]->tagging_list;
+}
+
+static BOOL
+cccrack_setup_symtag(cccrack_t *self)
+{
+  if (self->params.softfile != NULL)
+    TRY(symtag_load_reliabilities(self->symtag, self->params.softfile));
 
-        if (have_kays) {
-          rankdef->k = self->params.k;
-          rankdef->K = self->params.K;
-          rankdef->muT = rankdef->k * (rankdef->K - 1);
+  symtag_set_threads(self->symtag, self->params.threads);
+  symtag_set_numa(self->symtag, self->params.numa);
+  symtag_set_hugepages(self->symtag, self->params.hugepages);
 
-          TRY(cccrack_eval_candidate(self, rankdef));
-        } else {
-          /* No k, K provided. Test them all */
-          TRY(cccrack_enumerate_configs(self, rankdef));
-        }
+  return TRUE;
 
-        ok = TRUE;
-      }
+fail:
+  return FALSE;
+}
+
+cccrack_t *
+cccrack_new(const char *path, const struct cccrack_params *params)
+{
+  cccrack_t *self = NULL;
+
+  TRY(self = cccrack_alloc(params));
+
+  TRY(self->symtag = symtag_new_from_file(
+      path,
+      self->params.bps,
+      cccrack_on_tagging,
+      self));
+
+  TRY(cccrack_setup_symtag(self));
+
+  return self;
+
+fail:
+  if (self != NULL)
+    cccrack_destroy(self);
+
+  return NULL;
+}
+
+cccrack_t *
+cccrack_new_from_buffer(
+    const uint8_t *data,
+    uint64_t len,
+    cccrack_release_cb_t release,
+    void *release_private,
+    const struct cccrack_params *params)
+{
+  cccrack_t *self = NULL;
+
+  if ((self = cccrack_alloc(params)) == NULL) {
+    if (release != NULL)
+      (release) (release_private, data, len);
+    goto fail;
+  }
+
+  /* From now on, the symtag is responsible for releasing the buffer */
+  TRY(self->symtag = symtag_new_from_buffer(
+      data,
+      len,
+      release,
+      release_private,
+      self->params.bps,
+      cccrack_on_tagging,
+      self));
+
+  TRY(cccrack_setup_symtag(self));
+
+  return self;
+
+fail:
+  if (self != NULL)
+    cccrack_destroy(self);
+
+  return NULL;
+}
+
+/**************************** Streaming analysis ****************************/
+static void
+cccrack_stream_basis_finalize(struct cccrack_stream_basis *self)
+{
+  if (self->rows != NULL)
+    free(self->rows);
+
+  if (self->pivot != NULL)
+    free(self->pivot);
+
+  if (self->acc != NULL)
+    free(self->acc);
+}
+
+static void
+cccrack_stream_basis_reset(struct cccrack_stream_basis *self)
+{
+  unsigned int i;
+
+  for (i = 0; i < self->l; ++i)
+    self->pivot[i] = -1;
+
+  memset(self->acc, 0, self->blocks * sizeof(uint64_t));
+
+  self->rank = 0;
+  self->acc_bits = 0;
+  self->row_count = 0;
+  self->last_change = 0;
+}
+
+static BOOL
+cccrack_stream_basis_init(struct cccrack_stream_basis *self, unsigned int l)
+{
+  self->l = l;
+  self->blocks = GF2_MATRIX_ROW_BLOCKS(l);
+
+  ALLOCATE_MANY(self->rows, l * self->blocks, uint64_t);
+  ALLOCATE_MANY(self->pivot, l, int);
+  ALLOCATE_MANY(self->acc, self->blocks, uint64_t);
+
+  cccrack_stream_basis_reset(self);
+
+  return TRUE;
+
+fail:
+  return FALSE;
+}
+
+/* Reduce the accumulated row against the basis, and add it if needed */
+static void
+cccrack_stream_basis_insert(struct cccrack_stream_basis *self)
+{
+  uint64_t *row = self->acc;
+  const uint64_t *other;
+  unsigned int i, b, col;
+
+  ++self->row_count;
+
+  for (b = 0; b < self->blocks; ) {
+    if (row[b] == 0) {
+      ++b;
+      continue;
     }
 
-    gf2_matrix_destroy(R);
-    R = NULL;
+    col = (b << 6) + __builtin_ctzll(row[b]);
 
-    gf2_matrix_destroy(B);
-    B = NULL;
+    if (self->pivot[col] == -1) {
+      memcpy(
+          self->rows + self->rank * self->blocks,
+          row,
+          self->blocks * sizeof(uint64_t));
+      self->pivot[col] = self->rank++;
+      self->last_change = self->row_count;
+      break;
+    }
+
+    /* Basis rows have no bits below their pivot */
+    other = self->rows + self->pivot[col] * self->blocks;
+    for (i = b; i < self->blocks; ++i)
+      row[i] ^= other[i];
+  }
+
+  memset(row, 0, self->blocks * sizeof(uint64_t));
+  self->acc_bits = 0;
+}
+
+static inline void
+cccrack_stream_basis_push(struct cccrack_stream_basis *self, uint8_t bit)
+{
+  self->acc[GF2_MATRIX_ROW_BLOCK(self->acc_bits)] |=
+      (uint64_t) (bit & 1) << GF2_MATRIX_ROW_SHIFT(self->acc_bits);
+
+  if (++self->acc_bits == self->l)
+    cccrack_stream_basis_insert(self);
+}
+
+static BOOL
+cccrack_stream_basis_is_full(const struct cccrack_stream_basis *self)
+{
+  return self->rank == self->l;
+}
+
+static BOOL
+cccrack_stream_basis_is_deficient(const struct cccrack_stream_basis *self)
+{
+  return self->rank < self->l
+      && self->row_count >= self->l * CCCRACK_STREAM_MIN_REL_HEIGHT
+      && self->row_count - self->last_change
+          >= self->l * CCCRACK_STREAM_STABLE_REL_ROWS;
+}
+
+static void
+cccrack_stream_reset(cccrack_stream_t *self)
+{
+  unsigned int i;
+
+  for (i = 0; i < self->basis_count; ++i)
+    cccrack_stream_basis_reset(self->basis_list + i);
+
+  self->identified = FALSE;
+  self->announced = FALSE;
+  self->n_a = 0;
+  self->retry_pos = 0;
+}
+
+/* Candidate sink of the internal cracker */
+static int
+cccrack_stream_on_candidate(void *private, const cccrack_rankdef_t *candidate)
+{
+  cccrack_stream_t *self = (cccrack_stream_t *) private;
+
+  self->announced = TRUE;
+
+  return (self->on_event) (
+      self->private,
+      CCCRACK_STREAM_EVENT_FOUND,
+      self->bit_pos,
+      candidate);
+}
+
+void
+cccrack_stream_destroy(cccrack_stream_t *self)
+{
+  unsigned int i;
+
+  if (self->basis_list != NULL) {
+    for (i = 0; i < self->basis_count; ++i)
+      cccrack_stream_basis_finalize(self->basis_list + i);
+
+    free(self->basis_list);
+  }
+
+  if (self->cracker != NULL)
+    cccrack_destroy(self->cracker);
+
+  tagging_finalize(&self->tagging);
+
+  free(self);
+}
+
+/*
+ * The symbol-to-bits mapping is given by params->bps and params->tagging
+ * (defaulting to 1 bit per symbol and tagging 0).
+ */
+cccrack_stream_t *
+cccrack_stream_new(
+    const struct cccrack_params *params,
+    cccrack_stream_event_cb_t cb,
+    void *private)
+{
+  cccrack_stream_t *self = NULL;
+  unsigned int i;
+  unsigned int bps;
+
+  ALLOCATE(self, cccrack_stream_t);
+
+  TRY(self->cracker = cccrack_alloc(params));
+
+  self->cracker->params.on_candidate = cccrack_stream_on_candidate;
+  self->cracker->params.private = self;
+
+  bps = self->cracker->params.bps > 0 ? self->cracker->params.bps : 1;
+
+  TRY(tagging_init(&self->tagging, bps, 0));
+
+  if (self->cracker->params.tagging > 0) {
+    if ((uint64_t) self->cracker->params.tagging
+        >= tagging_get_count(&self->tagging)) {
+      ERROR(
+          "Tagging %d does not exist with %u bits per symbol\n",
+          self->cracker->params.tagging,
+          bps);
+      goto fail;
+    }
+
+    tagging_set_id(&self->tagging, self->cracker->params.tagging);
+  }
+
+  self->basis_count = cccrack_get_max_width(self->cracker) - 2;
+  ALLOCATE_MANY(
+      self->basis_list,
+      self->basis_count,
+      struct cccrack_stream_basis);
+
+  for (i = 0; i < self->basis_count; ++i)
+    TRY(cccrack_stream_basis_init(self->basis_list + i, i + 2));
+
+  self->private = private;
+  self->on_event = cb;
+
+  return self;
+
+fail:
+  if (self != NULL)
+    cccrack_stream_destroy(self);
+
+  return NULL;
+}
+
+/*
+ * Same analysis as cccrack_on_tagging, but on top of the stream bases.
+ * The basis at width n_a is expanded into a square matrix so that
+ * dual vectors are extracted exactly as in the batch case.
+ */
+static BOOL
+cccrack_stream_identify(cccrack_stream_t *self, unsigned int l1, unsigned int l2)
+{
+  const struct cccrack_stream_basis *basis = self->basis_list + l1 - 2;
+  gf2_matrix_t *R = NULL;
+  gf2_matrix_t *B = NULL;
+  cccrack_rankdef_t *rankdef = NULL;
+  unsigned int i;
+  BOOL ok = FALSE;
+
+  CONSTRUCT(R, gf2_matrix, l1, l1, FALSE);
+
+  for (i = 0; i < basis->rank; ++i)
+    memcpy(
+        R->row_data[i],
+        basis->rows + i * basis->blocks,
+        basis->blocks * sizeof(uint64_t));
+
+  TRY(gf2_matrix_gauss_jordan_cols(R, &B));
+  TRY(rankdef = cccrack_rankdef_from_matrices(&self->tagging, R, B));
+
+  if (self->cracker->params.n > 0)
+    rankdef->n = self->cracker->params.n;
+  else
+    cccrack_rankdef_set_second_defficiency(rankdef, l2);
+
+  TRY(cccrack_eval_template(self->cracker, rankdef, NULL));
+
+  /*
+   * Nothing likely came out of these deficiencies: they may still be
+   * unstable, or come from rows that predate the code. Start over from
+   * fresh rows, and give them some time before the next attempt.
+   */
+  if (!self->announced) {
+    for (i = 0; i < self->basis_count; ++i)
+      cccrack_stream_basis_reset(self->basis_list + i);
+    self->retry_pos = self->bit_pos
+        + (uint64_t) l1 * l1 * CCCRACK_STREAM_WINDOW_REL_ROWS;
+  } else {
+    self->identified = TRUE;
+    self->n_a = l1;
   }
 
   ok = TRUE;
@@ -604,43 +3645,151 @@ fail:
   return ok;
 }
 
-BOOL
-cccrack_run(cccrack_t *self)
+/*
+ * Bases only grow, so a prefix of noise or idle symbols would leave
+ * every width at full rank for good. Until a code is identified, full
+ * bases start over once they have taken CCCRACK_STREAM_WINDOW_REL_ROWS
+ * rows per column, unless some width is already deficient.
+ */
+static void
+cccrack_stream_bound_evidence(cccrack_stream_t *self)
 {
-  BOOL ok = FALSE;
+  struct cccrack_stream_basis *basis;
+  unsigned int i;
 
-  TRY(symtag_tag(self->symtag));
+  for (i = 0; i < self->basis_count; ++i)
+    if (cccrack_stream_basis_is_deficient(self->basis_list + i))
+      return;
 
-  ok = TRUE;
+  for (i = 0; i < self->basis_count; ++i) {
+    basis = self->basis_list + i;
+    if (cccrack_stream_basis_is_full(basis)
+        && basis->row_count >= basis->l * CCCRACK_STREAM_WINDOW_REL_ROWS)
+      cccrack_stream_basis_reset(basis);
+  }
+}
+
+static BOOL
+cccrack_stream_update(cccrack_stream_t *self)
+{
+  const struct cccrack_stream_basis *basis;
+  unsigned int i;
+  unsigned int l1 = 0;
+  BOOL need_second = self->cracker->params.n == 0;
+
+  if (self->identified) {
+    basis = self->basis_list + self->n_a - 2;
+
+    if (cccrack_stream_basis_is_full(basis)) {
+      if (self->announced)
+        TRY((self->on_event) (
+            self->private,
+            CCCRACK_STREAM_EVENT_LOST,
+            self->bit_pos,
+            NULL));
+
+      cccrack_stream_reset(self);
+    }
+
+    return TRUE;
+  }
+
+  if (self->bit_pos < self->retry_pos) {
+    cccrack_stream_bound_evidence(self);
+    return TRUE;
+  }
+
+  /* Widths below the deficient ones must be known to be full rank */
+  for (i = 0; i < self->basis_count; ++i) {
+    basis = self->basis_list + i;
+
+    if (cccrack_stream_basis_is_deficient(basis)) {
+      if (l1 == 0) {
+        l1 = basis->l;
+        if (!need_second)
+          return cccrack_stream_identify(self, l1, 0);
+      } else {
+        return cccrack_stream_identify(self, l1, basis->l);
+      }
+    } else if (!cccrack_stream_basis_is_full(basis)) {
+      break;
+    }
+  }
+
+  cccrack_stream_bound_evidence(self);
+
+  return TRUE;
 
 fail:
-  return ok;
+  return FALSE;
 }
 
-cccrack_t *
-cccrack_new(const char *path, const struct cccrack_params *params)
+int
+cccrack_stream_push_bits(
+    cccrack_stream_t *self,
+    const uint8_t *bits,
+    size_t len)
 {
-  const struct cccrack_params defparams = cccrack_params_INITIALIZER;
-  cccrack_t *self = NULL;
+  size_t p;
+  unsigned int i;
+  uint64_t rows;
+  BOOL new_rows;
 
-  if (params == NULL)
-    params = &defparams;
+  for (p = 0; p < len; ++p) {
+    new_rows = FALSE;
 
-  ALLOCATE(self, cccrack_t);
+    for (i = 0; i < self->basis_count; ++i) {
+      rows = self->basis_list[i].row_count;
+      cccrack_stream_basis_push(self->basis_list + i, bits[p]);
+      new_rows |= rows != self->basis_list[i].row_count;
+    }
 
-  self->params = *params;
+    ++self->bit_pos;
 
-  TRY(self->symtag = symtag_new_from_file(
-      path,
-      self->params.bps,
-      cccrack_on_tagging,
-      self));
+    if (new_rows)
+      TRY(cccrack_stream_update(self));
+  }
 
-  return self;
+  return TRUE;
 
 fail:
-  if (self != NULL)
-    cccrack_destroy(self);
+  return FALSE;
+}
 
-  return NULL;
+/* Symbols are ASCII characters, as in capture files */
+int
+cccrack_stream_push_symbols(
+    cccrack_stream_t *self,
+    const uint8_t *symbols,
+    size_t len)
+{
+  uint8_t bits[64];
+  unsigned int j, bps = self->tagging.bps;
+  uint8_t value;
+  size_t i;
+
+  for (i = 0; i < len; ++i) {
+    if (symbols[i] < '0' || symbols[i] >= '0' + 64)
+      continue;
+
+    if ((symbols[i] - '0') & ~self->tagging.mask) {
+      ERROR(
+          "Symbol `%c' does not fit in %u bits per symbol\n",
+          symbols[i],
+          bps);
+      goto fail;
+    }
+
+    value = self->tagging.dict[(symbols[i] - '0') & self->tagging.mask];
+
+    for (j = 0; j < bps; ++j)
+      bits[j] = (value >> (bps - j - 1)) & 1;
+
+    TRY(cccrack_stream_push_bits(self, bits, bps));
+  }
+
+  return TRUE;
+
+fail:
+  return FALSE;
 }
@@ -6,55 +6,102 @@
 #ifndef _MAIN_INCLUDE_H
 #define _MAIN_INCLUDE_H
 
-#include <config.h> /* General compile-time configuration parameters */
-#include <util.h> /* From util: Common utility library */
-#include "gf2types.h"
+#include <stdint.h>
+#include <stddef.h>
 
-#include "symtag.h"
+/*
+ * Public interface of libcccrack. Crackers, candidates and streams are
+ * opaque and only handled through the functions below. Flags, and the
+ * results of functions and callbacks, are ints: non-zero means true.
+ */
 
 #define CCCRACK_MAX_WIDTH      100
 #define CCCRACK_MAX_REL_HEIGHT 5
+#define CCCRACK_MAX_CONSTRAINT 64 /* Taps of G and H fit in 64-bit words */
 
-struct cccrack_rankdef {
-  struct tagging tagging;
-  PTR_LIST(uint8_t, h); /* Dual elements. There should be n-k of these */
-  PTR_LIST(uint64_t, h_poly); /* Polynomials */
-
-  PTR_LIST(uint8_t, g); /* Generator elements, one for each k */
-  PTR_LIST(uint64_t, g_poly); /* Polynomial form */
-
-  unsigned int n_a;
-  unsigned int n;
-  unsigned int k;
-  unsigned int K;
-  unsigned int muT;
-
-  BOOL likely;
-};
-
+typedef struct cccrack cccrack_t;
 typedef struct cccrack_rankdef cccrack_rankdef_t;
 
 void cccrack_rankdef_debug(const cccrack_rankdef_t *self);
+cccrack_rankdef_t *cccrack_rankdef_dup(const cccrack_rankdef_t *orig);
+void cccrack_rankdef_destroy(cccrack_rankdef_t *self);
+
+unsigned int cccrack_rankdef_get_tagging_id(const cccrack_rankdef_t *self);
+unsigned int cccrack_rankdef_get_n(const cccrack_rankdef_t *self);
+unsigned int cccrack_rankdef_get_k(const cccrack_rankdef_t *self);
+unsigned int cccrack_rankdef_get_K(const cccrack_rankdef_t *self);
+
+/* Dual polynomials and generators: n words each, one bit per delay */
+unsigned int cccrack_rankdef_get_h_count(const cccrack_rankdef_t *self);
+const uint64_t *cccrack_rankdef_get_h_poly(
+    const cccrack_rankdef_t *self,
+    unsigned int i);
+unsigned int cccrack_rankdef_get_g_count(const cccrack_rankdef_t *self);
+const uint64_t *cccrack_rankdef_get_g_poly(
+    const cccrack_rankdef_t *self,
+    unsigned int i);
+
+/* Bit j + n * t of generator i is the tap of output j at delay t */
+uint8_t cccrack_rankdef_get_g_bit(
+    const cccrack_rankdef_t *self,
+    unsigned int i,
+    unsigned int j);
+
+/* 1 if every check passes, 0 if they look random. -1 if not verified */
+float cccrack_rankdef_get_confidence(const cccrack_rankdef_t *self);
+
+/* Viterbi estimate of the bit error rate, -1 if not decoded */
+float cccrack_rankdef_get_ber(const cccrack_rankdef_t *self);
+
+int cccrack_rankdef_is_likely(const cccrack_rankdef_t *self);
+int cccrack_rankdef_is_gray(const cccrack_rankdef_t *self);
+
+enum cccrack_soft_metric {
+  CCCRACK_SOFT_METRIC_MIN, /* Row reliability is its least reliable bit */
+  CCCRACK_SOFT_METRIC_SUM  /* Row reliability is the sum of all |LLR| */
+};
 
-static inline BOOL
-cccrack_rankdef_is_likely(const cccrack_rankdef_t *self)
-{
-  return self->likely;
-}
+/*
+ * Candidate sink. When set, candidates are delivered as soon as every
+ * earlier tagging is done (in tagging order, one call at a time, from
+ * any of the worker threads but without holding any lock of the
+ * cracker) and destroyed right after the call, instead of being kept by
+ * the cracker. Returning 0 aborts the analysis.
+ */
+typedef int (*cccrack_candidate_cb_t) (
+    void *private,
+    const cccrack_rankdef_t *candidate);
 
-static inline BOOL
-cccrack_rankdef_is_gray(const cccrack_rankdef_t *self)
-{
-  return self->tagging.is_gray;
-}
+#define CCCRACK_VERIFY_DEFAULT_MAX_RATE .2
 
 struct cccrack_params {
   unsigned int bps;
   int tagging;
-  const char *dumpfile;
+  const char *dumpfile; /* Ignored unless tagging is set */
   unsigned int k, n, K;
-  BOOL no_gray;
-  BOOL all;
+  int no_gray;
+  int all;
+  const char *softfile;
+  enum cccrack_soft_metric soft_metric;
+  int hugepages;
+  unsigned int threads;   /* 0 is taken as 1 */
+  int numa;
+  cccrack_candidate_cb_t on_candidate;
+  void *private;
+  int unique;
+  float verify;          /* Fraction of the capture to verify, 0 disables */
+  float verify_max_rate; /* Highest violation rate of a likely candidate */
+  int decode;             /* Viterbi-decode rate 1/n candidates */
+  const char *decodefile; /* Prefix of decoded bit files, may be NULL */
+  unsigned int regions;   /* Regions voting on the rank analysis, 0 is 1 */
+  int estimate_n;         /* Sweep only multiples of the estimated period */
+  unsigned int max_width; /* Widest window, 0 for CCCRACK_MAX_WIDTH */
+  unsigned int max_rel_height; /* 0 for CCCRACK_MAX_REL_HEIGHT */
+  int adaptive;           /* Grow window heights until the rank settles */
+  float time_budget;      /* Seconds, 0 for none */
+  uint64_t memory_budget; /* Bytes for windows in flight, 0 for none */
+  int sample;             /* Take window rows from the whole capture */
+  uint64_t seed;          /* Of the row sampling */
 };
 
 #define cccrack_params_INITIALIZER      \
@@ -63,41 +110,118 @@ struct cccrack_params {
   -1, /* tagging */                      \
   NULL, /* dumpfile */                   \
   0, 0, 0, /* k, n, K */                 \
-  FALSE, /* no_gray */                   \
-  FALSE, /* all */                       \
+  0, /* no_gray */                       \
+  0, /* all */                           \
+  NULL, /* softfile */                   \
+  CCCRACK_SOFT_METRIC_MIN, /* soft_metric */ \
+  0, /* hugepages */                     \
+  1, /* threads */                       \
+  0, /* numa */                          \
+  NULL, /* on_candidate */               \
+  NULL, /* private */                    \
+  0, /* unique */                        \
+  0, /* verify */                        \
+  CCCRACK_VERIFY_DEFAULT_MAX_RATE, /* verify_max_rate */ \
+  0, /* decode */                        \
+  NULL, /* decodefile */                 \
+  1, /* regions */                       \
+  0, /* estimate_n */                    \
+  0, /* max_width */                     \
+  0, /* max_rel_height */                \
+  0, /* adaptive */                      \
+  0, /* time_budget */                   \
+  0, /* memory_budget */                 \
+  0, /* sample */                        \
+  1, /* seed */                          \
 }
 
-struct cccrack {
-  struct cccrack_params params;
-  symtag_t *symtag;
+void cccrack_destroy(cccrack_t *self);
 
-  PTR_LIST(cccrack_rankdef_t, rankdef); /* Equals to the number of taggins */
-};
+int cccrack_run(cccrack_t *self);
 
-typedef struct cccrack cccrack_t;
+cccrack_t *cccrack_new(const char *path, const struct cccrack_params *);
 
-static inline uint64_t
-cccrack_get_tagging_count(const cccrack_t *self)
-{
-  return symtag_get_tagging_count(self->symtag);
-}
+/*
+ * Crack a capture already held in memory, without copying it. The buffer
+ * must remain valid until `release' is called, which happens when the
+ * cracker is destroyed, or before returning if construction fails.
+ * Different instances may be run concurrently from different threads.
+ */
+typedef void (*cccrack_release_cb_t) (
+    void *private,
+    const uint8_t *data,
+    uint64_t len);
 
-static inline unsigned int
-cccrack_get_candidate_count(const cccrack_t *self)
-{
-  return self->rankdef_count;
-}
+cccrack_t *cccrack_new_from_buffer(
+    const uint8_t *data,
+    uint64_t len,
+    cccrack_release_cb_t release,
+    void *release_private,
+    const struct cccrack_params *params);
 
-static inline const cccrack_rankdef_t *
-cccrack_get_candidate(const cccrack_t *self, unsigned int i)
-{
-  return self->rankdef_list[i];
-}
+/* Whether the time budget ran out before all taggings were analyzed */
+int cccrack_is_incomplete(const cccrack_t *self);
 
-void cccrack_destroy(cccrack_t *self);
+uint64_t cccrack_get_tagging_count(const cccrack_t *self);
 
-BOOL cccrack_run(cccrack_t *self);
+/* Candidates kept by the cracker, i.e. without a candidate sink */
+unsigned int cccrack_get_candidate_count(const cccrack_t *self);
+const cccrack_rankdef_t *cccrack_get_candidate(
+    const cccrack_t *self,
+    unsigned int i);
 
-cccrack_t *cccrack_new(const char *path, const struct cccrack_params *);
+/*
+ * Unique codes in the order their first candidate was delivered, and
+ * the taggings that produced each of them. Requires params.unique.
+ */
+unsigned int cccrack_get_unique_count(const cccrack_t *self);
+const unsigned int *cccrack_get_unique_taggings(
+    const cccrack_t *self,
+    unsigned int i,
+    unsigned int *count);
+
+/*
+ * Streaming identification. Rows of every candidate width are appended
+ * to a persistent, already-eliminated basis as bits arrive. Once the
+ * first two rank deficiencies have been stable for a while, candidates
+ * are evaluated and reported. If the deficiency disappears (e.g. the
+ * transmitter switched codes), a loss event is reported and the
+ * analysis starts over from the current position.
+ *
+ * Until a code is found, the evidence is bounded: bases that reach full
+ * rank with no deficient width start over after a few rows per column,
+ * and all of them start over after a failed identification. A prefix of
+ * noise or idle symbols thus only delays the identification.
+ */
+enum cccrack_stream_event {
+  CCCRACK_STREAM_EVENT_FOUND,
+  CCCRACK_STREAM_EVENT_LOST
+};
+
+/* candidate is NULL for loss events. It is destroyed after the call. */
+typedef int (*cccrack_stream_event_cb_t) (
+    void *private,
+    enum cccrack_stream_event event,
+    uint64_t bit_pos,
+    const cccrack_rankdef_t *candidate);
+
+typedef struct cccrack_stream cccrack_stream_t;
+
+void cccrack_stream_destroy(cccrack_stream_t *self);
+
+cccrack_stream_t *cccrack_stream_new(
+    const struct cccrack_params *params,
+    cccrack_stream_event_cb_t cb,
+    void *private);
+
+int cccrack_stream_push_bits(
+    cccrack_stream_t *self,
+    const uint8_t *bits,
+    size_t len);
+
+int cccrack_stream_push_symbols(
+    cccrack_stream_t *self,
+    const uint8_t *symbols,
+    size_t len);
 
 #endif /* _MAIN_INCLUDE_H */
@@ -0,0 +1,237 @@
+/*
+  cccrack_internal.h: Private declarations of libcccrack
+
+  Copyright (C) 2019 Gonzalo José Carracedo Carballal
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this program.  If not, see
+  <http://www.gnu.org/licenses/>
+
+*/
+
+#ifndef _CCCRACK_INTERNAL_H
+#define _CCCRACK_INTERNAL_H
+
+#include <util.h> /* From util: Common utility library */
+#include "cccrack.h"
+#include "gf2types.h"
+#include "gf2poly.h"
+
+#include "symtag.h"
+#include "topk.h"
+#include "hugemem.h"
+#include "viterbi.h"
+
+#define CCCRACK_MIN_REGION_LEN 4096 /* Bits */
+#define CCCRACK_PROBE_MAX_WIDTH 128
+#define CCCRACK_SKETCH_OVERSAMPLE 32 /* Full rank misflagged w.p. < 2^-32 */
+
+#define CCCRACK_PERIOD_WORD_BITS 16
+#define CCCRACK_PERIOD_MAX       8
+#define CCCRACK_PERIOD_SAMPLES   16384 /* Fits the int16_t spectrum */
+#define CCCRACK_PERIOD_MIN_SAMPLES 2048
+#define CCCRACK_PERIOD_MIN_BIAS  .25
+#define CCCRACK_PERIOD_NO_BIAS   .1 /* Below 1/CCCRACK_PERIOD_MAX */
+
+#define CCCRACK_MAX_DICT_LEN   64
+#define CCCRACK_UNIQUE_MAX_PERM 8 /* 8! arrangements per candidate, at most */
+
+/* Bit-packed dual vectors, shared by all candidates of the same template */
+struct cccrack_duals {
+  unsigned int refs;
+  unsigned int length; /* Bits per vector (n_a) */
+  unsigned int blocks; /* Words per vector */
+  unsigned int count;
+  uint64_t hash;       /* Of length and contents */
+  uint64_t bits[];
+};
+
+static inline uint8_t
+cccrack_duals_get(
+    const struct cccrack_duals *self,
+    unsigned int i,
+    unsigned int j)
+{
+  if (j >= self->length)
+    return 0;
+
+  return (self->bits[i * self->blocks + GF2_MATRIX_ROW_BLOCK(j)]
+      >> GF2_MATRIX_ROW_SHIFT(j)) & 1;
+}
+
+/*
+ * A candidate is a single allocation: the header below followed by the
+ * dual polynomials, the generator polynomials and the bit-packed
+ * generators. The dual vectors themselves are shared.
+ */
+struct cccrack_rankdef {
+  struct tagging tagging;
+  uint8_t dict[CCCRACK_MAX_DICT_LEN]; /* tagging.dict points here */
+
+  struct cccrack_duals *duals; /* Dual elements. There should be n-k of these */
+
+  unsigned int n_a;
+  unsigned int n;
+  unsigned int k;
+  unsigned int K;
+  unsigned int muT;
+
+  BOOL likely;
+  float violation_rate; /* Of the parity checks, -1 if not verified */
+  float ber;            /* Viterbi estimate, -1 if not decoded */
+  unsigned int decode_phase; /* Output phase giving the best decoding */
+
+  unsigned int h_count;  /* Dual polynomials, n words each */
+  unsigned int g_count;  /* Generators, one for each k */
+  unsigned int g_blocks; /* Words per packed generator (n * K bits) */
+
+  uint64_t *h_poly;
+  uint64_t *g_poly;
+  uint64_t *g;
+
+  size_t size; /* Of the whole allocation */
+  uint64_t data[];
+};
+
+/*
+ * Candidates that describe the same code are merged when params.unique
+ * is set. The key is (k, n, K) plus the generator polynomials, sorted
+ * so that output permutations collapse. Output complements do not
+ * change the polynomials.
+ */
+struct cccrack_unique {
+  uint64_t hash;
+  uint64_t *key;
+  unsigned int key_len;
+  VECTOR(unsigned int, tagging); /* Taggings that produced this code */
+  struct cccrack_unique *next;   /* Same bucket */
+};
+
+struct cccrack_unique_index {
+  struct cccrack_unique **bucket_list;
+  unsigned int bucket_count; /* Power of 2 */
+  VECTOR(struct cccrack_unique *, unique); /* In discovery order */
+};
+
+/* Packed bits of the tagging under analysis */
+struct cccrack_capture {
+  const uint64_t *packed; /* Followed by a zero word */
+  uint64_t len;
+};
+
+/*
+ * Each region of the capture is analyzed on its own. The deficient
+ * widths and the dual vectors are then decided by majority.
+ */
+struct cccrack_region {
+  uint64_t start;
+  uint64_t len;
+  unsigned int first;  /* First deficient width, 0 if none */
+  unsigned int second; /* Second deficient width, 0 if none */
+  unsigned int step;   /* Between swept widths */
+  struct cccrack_duals *duals; /* At the first deficient width */
+};
+
+struct cccrack {
+  struct cccrack_params params;
+  symtag_t *symtag;
+
+  /* Taggings may be evaluated concurrently. Protects everything below */
+  pthread_mutex_t lock;
+  BOOL have_lock;
+
+  /* Most reliable rows for each window width, sorted by position */
+  uint64_t **rowsel;
+
+  double deadline;    /* Of the time budget, if any */
+  BOOL out_of_time;   /* Some taggings were not fully analyzed */
+
+  /*
+   * While cccrack_run tags the capture, candidates wait in pending until
+   * every earlier tagging is finished. They are then delivered in tagging
+   * order by one thread at a time (the one that set delivering), outside
+   * the lock. Only that thread touches rankdef and index meanwhile.
+   */
+  BOOL ordered;
+  BOOL delivering;
+  BOOL sink_failed;
+  uint64_t next_tagging;      /* All taggings below this one are finished */
+  VECTOR(uint64_t, finished); /* Finished past next_tagging, sorted */
+  VECTOR(cccrack_rankdef_t *, pending);
+
+  VECTOR(cccrack_rankdef_t *, rankdef); /* Equals to the number of taggins */
+  struct cccrack_unique_index *index; /* If params.unique */
+};
+
+static inline unsigned int
+cccrack_get_max_width(const cccrack_t *self)
+{
+  return self->params.max_width > 0
+      ? self->params.max_width
+      : CCCRACK_MAX_WIDTH;
+}
+
+/*
+ * Threads a single tagging may use. When taggings run in parallel, the
+ * threads are already busy.
+ */
+static inline unsigned int
+cccrack_get_inner_threads(const cccrack_t *self)
+{
+  return self->params.tagging != -1 ? self->params.threads : 1;
+}
+
+static inline unsigned int
+cccrack_get_max_rel_height(const cccrack_t *self)
+{
+  return self->params.max_rel_height > 0
+      ? self->params.max_rel_height
+      : CCCRACK_MAX_REL_HEIGHT;
+}
+
+#define CCCRACK_STREAM_MIN_REL_HEIGHT 2 /* Rows needed, relative to width */
+#define CCCRACK_STREAM_STABLE_REL_ROWS 1 /* Rows without rank changes */
+#define CCCRACK_STREAM_WINDOW_REL_ROWS 8 /* Rows before full bases restart */
+
+struct cccrack_stream_basis {
+  unsigned int l;
+  unsigned int blocks;
+  uint64_t *rows;     /* Echelon basis, rows[i] has its lowest bit at pivot */
+  int *pivot;         /* Basis row whose lowest set bit is col, or -1 */
+  unsigned int rank;
+
+  uint64_t *acc;      /* Row under construction */
+  unsigned int acc_bits;
+
+  uint64_t row_count;
+  uint64_t last_change;
+};
+
+struct cccrack_stream {
+  cccrack_t *cracker;  /* Holds parameters and collects candidates */
+  struct tagging tagging;
+
+  struct cccrack_stream_basis *basis_list;
+  unsigned int basis_count;
+
+  uint64_t bit_pos;
+  BOOL identified;
+  BOOL announced;
+  unsigned int n_a;
+  uint64_t retry_pos; /* No identification attempts before this bit */
+
+  void *private;
+  cccrack_stream_event_cb_t on_event;
+};
+
+#endif /* _CCCRACK_INTERNAL_H */
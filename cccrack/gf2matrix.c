@@ -20,38 +20,47 @@
 */
 
 #include "gf2types.h"
+#include "hugemem.h"
+
+#include <string.h>
+#include <pthread.h>
 
 void
 gf2_matrix_destroy(gf2_matrix_t *self)
 {
-  unsigned int i;
-
-  if (self->row_data != NULL) {
-    for (i = 0; i < self->rows; ++i)
-      if (self->row_data[i] != NULL)
-        free(self->row_data[i]);
+  if (self->slab != NULL)
+    hugemem_free(self->slab);
 
+  if (self->row_data != NULL)
     free(self->row_data);
-  }
+
+  if (self->pivots != NULL)
+    free(self->pivots);
 
   free(self);
 }
 
+/* If huge, big slabs are backed by huge pages */
 gf2_matrix_t *
-gf2_matrix_new(unsigned int rows, unsigned int cols)
+gf2_matrix_new(unsigned int rows, unsigned int cols, BOOL huge)
 {
   gf2_matrix_t *self = NULL;
   unsigned int i;
 
   ALLOCATE(self, gf2_matrix_t);
-  ALLOCATE_MANY(self->row_data, rows, uint64_t *);
+  ALLOCATE_MANY(self->row_data, MAX(rows, 1), uint64_t *);
 
   self->blocks = GF2_MATRIX_ROW_BLOCKS(cols);
   self->rows   = rows;
   self->cols   = cols;
+  self->huge   = huge;
+
+  TRY(self->slab = hugemem_alloc(
+      (size_t) rows * self->blocks * sizeof(uint64_t),
+      huge));
 
   for (i = 0; i < rows; ++i)
-    ALLOCATE_MANY(self->row_data[i], self->blocks, uint64_t);
+    self->row_data[i] = self->slab + (size_t) i * self->blocks;
 
   return self;
 
@@ -68,7 +77,7 @@ gf2_matrix_eye(unsigned int rows, unsigned int cols)
   gf2_matrix_t *self = NULL;
   unsigned int min, i;
 
-  CONSTRUCT(self, gf2_matrix, rows, cols);
+  CONSTRUCT(self, gf2_matrix, rows, cols, FALSE);
 
   min = MIN(rows, cols);
 
@@ -90,7 +99,7 @@ gf2_matrix_transpose(const gf2_matrix_t *mat)
   gf2_matrix_t *self = NULL;
   unsigned int i, j;
 
-  CONSTRUCT(self, gf2_matrix, mat->cols, mat->rows);
+  CONSTRUCT(self, gf2_matrix, mat->cols, mat->rows, mat->huge);
 
   for (j = 0; j < mat->rows; ++j)
     for (i = 0; i < mat->cols; ++i)
@@ -105,6 +114,38 @@ fail:
   return NULL;
 }
 
+/*
+ * Copy cols bits of a packed bit stream, starting at bit offset, into
+ * a row. Bit i of the stream goes to bit i % 64 of word i / 64. The
+ * stream is read one word past the slice, which must be readable.
+ */
+void
+gf2_matrix_load_row(
+    gf2_matrix_t *self,
+    unsigned int row,
+    const uint64_t *packed,
+    uint64_t offset)
+{
+  const uint64_t *src = packed + (offset >> 6);
+  unsigned int shift = offset & 63;
+  unsigned int last = self->blocks - 1;
+  uint64_t *dest;
+  unsigned int i;
+
+  assert(row < self->rows);
+
+  dest = self->row_data[row];
+
+  if (shift == 0)
+    memcpy(dest, src, self->blocks * sizeof(uint64_t));
+  else
+    for (i = 0; i < self->blocks; ++i)
+      dest[i] = (src[i] >> shift) | (src[i + 1] << (64 - shift));
+
+  if (GF2_MATRIX_ROW_SHIFT(self->cols) != 0)
+    dest[last] &= (1ull << GF2_MATRIX_ROW_SHIFT(self->cols)) - 1;
+}
+
 void
 gf2_matrix_swap_rows(gf2_matrix_t *self, unsigned int a, unsigned int b)
 {
@@ -182,8 +223,31 @@ gf2_matrix_debug(const gf2_matrix_t *self, BOOL transpose)
   putchar(10);
 }
 
-BOOL
-gf2_matrix_gauss_jordan_cols(gf2_matrix_t *self, gf2_matrix_t **b)
+static BOOL
+gf2_matrix_reset_pivots(gf2_matrix_t *self, unsigned int count)
+{
+  if (self->pivots == NULL) {
+    ALLOCATE_MANY(
+        self->pivots,
+        GF2_MATRIX_ROW_BLOCKS(MAX(self->rows, self->cols)),
+        uint64_t);
+  } else {
+    memset(
+        self->pivots,
+        0,
+        GF2_MATRIX_ROW_BLOCKS(count) * sizeof(uint64_t));
+  }
+
+  return TRUE;
+
+fail:
+  return FALSE;
+}
+
+#ifdef CCCRACK_CHECKS
+/* Reference elimination, one bit at a time */
+static BOOL
+gf2_matrix_gauss_jordan_cols_bitwise(gf2_matrix_t *self, gf2_matrix_t **b)
 {
   gf2_matrix_t *b_m = NULL;
   unsigned int i, j, rank;
@@ -194,6 +258,8 @@ gf2_matrix_gauss_jordan_cols(gf2_matrix_t *self, gf2_matrix_t **b)
   if (b != NULL)
     TRY(b_m = gf2_matrix_eye(self->cols, self->cols));
 
+  TRY(gf2_matrix_reset_pivots(self, self->cols));
+
   rank = 0;
 
   for (i = 0; i < self->cols; ++i) {
@@ -217,6 +283,7 @@ gf2_matrix_gauss_jordan_cols(gf2_matrix_t *self, gf2_matrix_t **b)
         }
       }
 
+      self->pivots[GF2_MATRIX_ROW_BLOCK(i)] |= 1ull << GF2_MATRIX_ROW_SHIFT(i);
       ++rank;
     }
   }
@@ -235,6 +302,505 @@ fail:
   return FALSE;
 }
 
+static gf2_matrix_t *
+gf2_matrix_dup(const gf2_matrix_t *self)
+{
+  gf2_matrix_t *new = NULL;
+  unsigned int i;
+
+  TRY(new = gf2_matrix_new(self->rows, self->cols, FALSE));
+
+  for (i = 0; i < self->rows; ++i)
+    memcpy(
+        new->row_data[i],
+        self->row_data[i],
+        self->blocks * sizeof(uint64_t));
+
+  return new;
+
+fail:
+  return NULL;
+}
+
+static BOOL
+gf2_matrix_equals(const gf2_matrix_t *a, const gf2_matrix_t *b)
+{
+  unsigned int i;
+
+  for (i = 0; i < a->rows; ++i)
+    if (memcmp(a->row_data[i], b->row_data[i], a->blocks * sizeof(uint64_t)))
+      return FALSE;
+
+  return TRUE;
+}
+
+/* Eliminate ref the reference way, and compare it with the fast result */
+static void
+gf2_matrix_check_elim(gf2_matrix_t *ref, gf2_matrix_t *self, gf2_matrix_t *b)
+{
+  gf2_matrix_t *b_ref = NULL;
+
+  if (!gf2_matrix_gauss_jordan_cols_bitwise(ref, b != NULL ? &b_ref : NULL)) {
+    WARNING("Check: reference elimination failed\n");
+    return;
+  }
+
+  if (ref->rank != self->rank
+      || memcmp(
+          ref->pivots,
+          self->pivots,
+          GF2_MATRIX_ROW_BLOCKS(self->cols) * sizeof(uint64_t)) != 0
+      || !gf2_matrix_equals(ref, self)
+      || (b != NULL && !gf2_matrix_equals(b_ref, b)))
+    WARNING(
+        "Check: %ux%u elimination differs from the reference\n",
+        self->rows,
+        self->cols);
+
+  if (b_ref != NULL)
+    gf2_matrix_destroy(b_ref);
+}
+#endif /* CCCRACK_CHECKS */
+
+/*
+ * Column elimination on packed rows. Adding column i to every column
+ * set in the pivot row amounts to xoring one mask (the pivot row past
+ * the pivot) into every row holding the pivot bit. Those rows (and those
+ * of b) are split among the threads: one of them looks for the pivot and
+ * the others wait for it at a barrier, then all of them update their
+ * rows and meet again before the next step. The result does not depend
+ * on the number of threads.
+ */
+#define GF2_MATRIX_MT_MIN_WORDS 65536 /* Per step, below this stay serial */
+
+struct gf2_matrix_barrier {
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+  unsigned int count; /* 0 until all threads are started */
+  unsigned int waiting;
+  unsigned int generation;
+};
+
+struct gf2_matrix_elim {
+  gf2_matrix_t *self;
+  gf2_matrix_t *b;
+  uint64_t *mask; /* Pivot row past the pivot */
+  BOOL pivot;
+  unsigned int workers;
+  struct gf2_matrix_barrier barrier;
+};
+
+struct gf2_matrix_elim_job {
+  struct gf2_matrix_elim *elim;
+  unsigned int index;
+  pthread_t thread;
+  BOOL have_thread;
+};
+
+static void
+gf2_matrix_barrier_wait(struct gf2_matrix_barrier *self)
+{
+  unsigned int generation;
+
+  pthread_mutex_lock(&self->mutex);
+
+  generation = self->generation;
+
+  if (++self->waiting == self->count) {
+    self->waiting = 0;
+    ++self->generation;
+    pthread_cond_broadcast(&self->cond);
+  } else {
+    while (generation == self->generation)
+      pthread_cond_wait(&self->cond, &self->mutex);
+  }
+
+  pthread_mutex_unlock(&self->mutex);
+}
+
+static void
+gf2_matrix_elim_step(
+    struct gf2_matrix_elim *elim,
+    unsigned int i,
+    unsigned int index)
+{
+  gf2_matrix_t *self = elim->self;
+  gf2_matrix_t *b = elim->b;
+  unsigned int block = GF2_MATRIX_ROW_BLOCK(i);
+  unsigned int shift = GF2_MATRIX_ROW_SHIFT(i);
+  unsigned int first, last;
+  unsigned int j, k;
+
+  first = (uint64_t) self->rows * index / elim->workers;
+  last  = (uint64_t) self->rows * (index + 1) / elim->workers;
+
+  for (j = first; j < last; ++j)
+    if ((self->row_data[j][block] >> shift) & 1)
+      for (k = block; k < self->blocks; ++k)
+        self->row_data[j][k] ^= elim->mask[k];
+
+  if (b != NULL) {
+    first = (uint64_t) b->rows * index / elim->workers;
+    last  = (uint64_t) b->rows * (index + 1) / elim->workers;
+
+    for (j = MAX(first, i + 1); j < last; ++j)
+      if ((elim->mask[GF2_MATRIX_ROW_BLOCK(j)] >> GF2_MATRIX_ROW_SHIFT(j)) & 1)
+        gf2_matrix_add_rows(b, j, i);
+  }
+}
+
+/* Same pivot search as the serial version */
+static void
+gf2_matrix_elim_pivot(struct gf2_matrix_elim *elim, unsigned int i)
+{
+  gf2_matrix_t *self = elim->self;
+  unsigned int block = GF2_MATRIX_ROW_BLOCK(i);
+  unsigned int shift = GF2_MATRIX_ROW_SHIFT(i);
+  unsigned int j;
+
+  if ((elim->pivot = gf2_matrix_get(self, i, i)) == 0) {
+    for (j = i + 1; j < self->rows; ++j) {
+      if (gf2_matrix_get(self, j, i) != 0) {
+        gf2_matrix_swap_rows(self, j, i);
+        elim->pivot = TRUE;
+        break;
+      }
+    }
+  }
+
+  if (elim->pivot) {
+    memcpy(
+        elim->mask,
+        self->row_data[i],
+        self->blocks * sizeof(uint64_t));
+    elim->mask[block] &= ~((1ull << shift << 1) - 1);
+
+    self->pivots[block] |= 1ull << shift;
+    ++self->rank;
+  }
+}
+
+static void
+gf2_matrix_elim_job_run(struct gf2_matrix_elim_job *job)
+{
+  struct gf2_matrix_elim *elim = job->elim;
+  unsigned int i;
+
+  /* Wait until the number of workers is known */
+  gf2_matrix_barrier_wait(&elim->barrier);
+
+  for (i = 0; i < elim->self->cols; ++i) {
+    if (job->index == 0)
+      gf2_matrix_elim_pivot(elim, i);
+
+    gf2_matrix_barrier_wait(&elim->barrier);
+
+    if (elim->pivot)
+      gf2_matrix_elim_step(elim, i, job->index);
+
+    gf2_matrix_barrier_wait(&elim->barrier);
+  }
+}
+
+/* Same steps, without threads */
+static void
+gf2_matrix_elim_run_serial(struct gf2_matrix_elim *elim)
+{
+  unsigned int i;
+
+  for (i = 0; i < elim->self->cols; ++i) {
+    gf2_matrix_elim_pivot(elim, i);
+
+    if (elim->pivot)
+      gf2_matrix_elim_step(elim, i, 0);
+  }
+}
+
+static void *
+gf2_matrix_elim_job_thread(void *data)
+{
+  gf2_matrix_elim_job_run(data);
+
+  return NULL;
+}
+
+BOOL
+gf2_matrix_gauss_jordan_cols_mt(
+    gf2_matrix_t *self,
+    gf2_matrix_t **b,
+    unsigned int threads)
+{
+  struct gf2_matrix_elim elim;
+  struct gf2_matrix_elim_job *jobs = NULL;
+  BOOL have_sync = FALSE;
+  unsigned int i;
+#ifdef CCCRACK_CHECKS
+  gf2_matrix_t *ref = NULL;
+#endif /* CCCRACK_CHECKS */
+  BOOL ok = FALSE;
+
+  assert(self->cols <= self->rows);
+
+  threads = MIN(threads, self->rows);
+
+  if ((uint64_t) self->rows * self->blocks < GF2_MATRIX_MT_MIN_WORDS)
+    threads = 1;
+
+  memset(&elim, 0, sizeof(struct gf2_matrix_elim));
+  elim.self    = self;
+  elim.workers = 1;
+
+#ifdef CCCRACK_CHECKS
+  TRY(ref = gf2_matrix_dup(self));
+#endif /* CCCRACK_CHECKS */
+
+  if (b != NULL)
+    TRY(elim.b = gf2_matrix_eye(self->cols, self->cols));
+
+  TRY(gf2_matrix_reset_pivots(self, self->cols));
+  self->rank = 0;
+
+  ALLOCATE_MANY(elim.mask, self->blocks, uint64_t);
+
+  if (threads < 2) {
+    gf2_matrix_elim_run_serial(&elim);
+    goto done;
+  }
+
+  ALLOCATE_MANY(jobs, threads, struct gf2_matrix_elim_job);
+
+  TRY(pthread_mutex_init(&elim.barrier.mutex, NULL) == 0);
+  if (pthread_cond_init(&elim.barrier.cond, NULL) != 0) {
+    pthread_mutex_destroy(&elim.barrier.mutex);
+    goto fail;
+  }
+  have_sync = TRUE;
+
+  for (i = 0; i < threads; ++i) {
+    jobs[i].elim  = &elim;
+    jobs[i].index = i;
+  }
+
+  /* If some thread cannot be started, the rest split the work */
+  for (i = 1; i < threads; ++i) {
+    if (pthread_create(
+        &jobs[i].thread,
+        NULL,
+        gf2_matrix_elim_job_thread,
+        jobs + i) != 0)
+      break;
+    jobs[i].have_thread = TRUE;
+  }
+
+  pthread_mutex_lock(&elim.barrier.mutex);
+  elim.workers = elim.barrier.count = i;
+  pthread_mutex_unlock(&elim.barrier.mutex);
+
+  gf2_matrix_elim_job_run(jobs);
+
+done:
+  if (b != NULL) {
+    *b = elim.b;
+    elim.b = NULL;
+  }
+
+  ok = TRUE;
+
+fail:
+  if (jobs != NULL) {
+    for (i = 1; i < threads; ++i)
+      if (jobs[i].have_thread)
+        pthread_join(jobs[i].thread, NULL);
+
+    free(jobs);
+  }
+
+#ifdef CCCRACK_CHECKS
+  if (ref != NULL) {
+    if (ok)
+      gf2_matrix_check_elim(ref, self, b != NULL ? *b : NULL);
+
+    gf2_matrix_destroy(ref);
+  }
+#endif /* CCCRACK_CHECKS */
+
+  if (have_sync) {
+    pthread_cond_destroy(&elim.barrier.cond);
+    pthread_mutex_destroy(&elim.barrier.mutex);
+  }
+
+  if (elim.mask != NULL)
+    free(elim.mask);
+
+  if (elim.b != NULL)
+    gf2_matrix_destroy(elim.b);
+
+  return ok;
+}
+
+BOOL
+gf2_matrix_gauss_jordan_cols(gf2_matrix_t *self, gf2_matrix_t **b)
+{
+  return gf2_matrix_gauss_jordan_cols_mt(self, b, 1);
+}
+
+/*
+ * After gf2_matrix_gauss_jordan_cols(self, &b), the rows of b matching
+ * the null columns of self span the right null space of the original
+ * matrix. Copy them to basis (if not NULL) and return how many.
+ */
+unsigned int
+gf2_matrix_null_space(
+    const gf2_matrix_t *self,
+    const gf2_matrix_t *b,
+    uint64_t *basis)
+{
+  unsigned int i, count = 0;
+
+  for (i = 0; i < self->cols; ++i)
+    if (gf2_matrix_col_is_free(self, i)) {
+      if (basis != NULL)
+        memcpy(
+            basis + count * b->blocks,
+            b->row_data[i],
+            b->blocks * sizeof(uint64_t));
+      ++count;
+    }
+
+  return count;
+}
+
+/*
+ * Bring self to reduced row echelon form. Unlike the eliminations in
+ * this file, the result only depends on the row space, so two matrices
+ * spanning the same space end up identical. Returns the rank.
+ */
+unsigned int
+gf2_matrix_rref(gf2_matrix_t *self)
+{
+  unsigned int i, j, col;
+  unsigned int block;
+  uint64_t mask;
+  unsigned int rank = 0;
+
+  for (col = 0; col < self->cols && rank < self->rows; ++col) {
+    block = GF2_MATRIX_ROW_BLOCK(col);
+    mask  = 1ull << GF2_MATRIX_ROW_SHIFT(col);
+
+    for (i = rank; i < self->rows; ++i)
+      if ((self->row_data[i][block] & mask) != 0)
+        break;
+
+    if (i == self->rows)
+      continue;
+
+    gf2_matrix_swap_rows(self, rank, i);
+
+    for (j = 0; j < self->rows; ++j)
+      if (j != rank && (self->row_data[j][block] & mask) != 0)
+        gf2_matrix_add_rows(self, j, rank);
+
+    ++rank;
+  }
+
+  self->rank = rank;
+
+  return rank;
+}
+
+/*
+ * Packed basis of the right null space, one vector per row, from the
+ * result of gf2_matrix_gauss_jordan_cols(self, &b). If reduced, the
+ * basis is returned in reduced row echelon form. The result may have
+ * no rows at all.
+ */
+gf2_matrix_t *
+gf2_matrix_kernel(const gf2_matrix_t *self, const gf2_matrix_t *b, BOOL reduced)
+{
+  gf2_matrix_t *kernel = NULL;
+  unsigned int count;
+
+  count = gf2_matrix_null_space(self, b, NULL);
+
+  CONSTRUCT(kernel, gf2_matrix, count, b->cols, FALSE);
+
+  /* Rows of a fresh matrix are contiguous in the slab */
+  gf2_matrix_null_space(self, b, kernel->slab);
+  kernel->rank = count;
+
+  if (reduced)
+    gf2_matrix_rref(kernel);
+
+  return kernel;
+
+fail:
+  return NULL;
+}
+
+/*
+ * Monte Carlo test for rank < cols, meant for tall and wide matrices.
+ * Only cols + oversample random combinations of the rows of self are
+ * eliminated. Any linear dependency among the columns survives in
+ * them, so a deficient matrix is always reported as deficient. A full
+ * rank one is wrongly reported as deficient with probability below
+ * 2^-oversample. A positive answer should be confirmed by a full
+ * elimination. The same seed always gives the same sketch.
+ */
+BOOL
+gf2_matrix_sketch_is_deficient(
+    const gf2_matrix_t *self,
+    unsigned int oversample,
+    uint64_t seed,
+    BOOL *deficient)
+{
+  gf2_matrix_t *sketch = NULL;
+  unsigned int rows = self->cols + oversample;
+  unsigned int i, j, k, w;
+  uint64_t bits;
+  BOOL ok = FALSE;
+
+  if (self->rows < self->cols) {
+    *deficient = TRUE;
+    return TRUE;
+  }
+
+  if (rows >= self->rows) {
+    /* Nothing to save: eliminate a copy, which is exact */
+    CONSTRUCT(sketch, gf2_matrix, self->rows, self->cols, self->huge);
+
+    for (j = 0; j < self->rows; ++j)
+      memcpy(
+          sketch->row_data[j],
+          self->row_data[j],
+          self->blocks * sizeof(uint64_t));
+  } else {
+    CONSTRUCT(sketch, gf2_matrix, rows, self->cols, self->huge);
+
+    /* Each row of self goes to a random half of the sketch rows */
+    for (j = 0; j < self->rows; ++j)
+      for (i = 0; i < rows; i += 64) {
+        bits = splitmix64_next(&seed);
+
+        for (; bits != 0; bits &= bits - 1) {
+          k = i + __builtin_ctzll(bits);
+          if (k < rows)
+            for (w = 0; w < self->blocks; ++w)
+              sketch->row_data[k][w] ^= self->row_data[j][w];
+        }
+      }
+  }
+
+  *deficient = gf2_matrix_rref(sketch) < self->cols;
+
+  ok = TRUE;
+
+fail:
+  if (sketch != NULL)
+    gf2_matrix_destroy(sketch);
+
+  return ok;
+}
+
 uint8_t *
 gf2_matrix_copy_row(const gf2_matrix_t *self, unsigned int row)
 {
@@ -281,6 +847,8 @@ gf2_matrix_gauss_jordan_rows(gf2_matrix_t *self, gf2_matrix_t **b)
   if (b != NULL)
     TRY(b_m = gf2_matrix_eye(self->rows, self->rows));
 
+  TRY(gf2_matrix_reset_pivots(self, self->rows));
+
   rank = 0;
 
   for (i = 0; i < self->rows; ++i) {
@@ -304,6 +872,7 @@ gf2_matrix_gauss_jordan_rows(gf2_matrix_t *self, gf2_matrix_t **b)
         }
       }
 
+      self->pivots[GF2_MATRIX_ROW_BLOCK(i)] |= 1ull << GF2_MATRIX_ROW_SHIFT(i);
       ++rank;
     }
   }
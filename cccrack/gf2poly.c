@@ -0,0 +1,535 @@
+/*
+  gf2poly.c: GF(2)[x] polynomial arithmetic
+
+  Copyright (C) 2019 Gonzalo José Carracedo Carballal
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this program.  If not, see
+  <http://www.gnu.org/licenses/>
+
+*/
+
+#include <string.h>
+#include <stdlib.h>
+
+#include "gf2poly.h"
+
+#ifdef __x86_64__
+#  include <emmintrin.h>
+#  include <wmmintrin.h>
+#  define GF2_POLY_HAVE_PCLMUL
+#endif /* __x86_64__ */
+
+/************************** Carry-less multiplication ***********************/
+static uint64_t
+gf2_poly_clmul_generic(uint64_t a, uint64_t b, uint64_t *hi)
+{
+  uint64_t lo = 0;
+  unsigned int i;
+
+  *hi = 0;
+
+  while (b != 0) {
+    i = __builtin_ctzll(b);
+
+    lo ^= a << i;
+    if (i != 0)
+      *hi ^= a >> (64 - i);
+
+    b &= b - 1;
+  }
+
+  return lo;
+}
+
+#ifdef GF2_POLY_HAVE_PCLMUL
+static uint64_t __attribute__((target("pclmul,sse2")))
+gf2_poly_clmul_pclmul(uint64_t a, uint64_t b, uint64_t *hi)
+{
+  __m128i prod = _mm_clmulepi64_si128(
+      _mm_cvtsi64_si128((long long) a),
+      _mm_cvtsi64_si128((long long) b),
+      0x00);
+
+  *hi = (uint64_t) _mm_cvtsi128_si64(_mm_unpackhi_epi64(prod, prod));
+
+  return (uint64_t) _mm_cvtsi128_si64(prod);
+}
+#endif /* GF2_POLY_HAVE_PCLMUL */
+
+typedef uint64_t (*gf2_poly_clmul_func_t) (uint64_t, uint64_t, uint64_t *);
+
+/* Racing on the first call is harmless: every thread picks the same one */
+static gf2_poly_clmul_func_t
+gf2_poly_get_clmul(void)
+{
+  static gf2_poly_clmul_func_t func = NULL;
+
+  if (func == NULL) {
+#ifdef GF2_POLY_HAVE_PCLMUL
+    if (__builtin_cpu_supports("pclmul"))
+      func = gf2_poly_clmul_pclmul;
+    else
+#endif /* GF2_POLY_HAVE_PCLMUL */
+      func = gf2_poly_clmul_generic;
+  }
+
+  return func;
+}
+
+uint64_t
+gf2_poly_clmul(uint64_t a, uint64_t b, uint64_t *hi)
+{
+  return (gf2_poly_get_clmul()) (a, b, hi);
+}
+
+/******************************* Storage ************************************/
+void
+gf2_poly_destroy(gf2_poly_t *self)
+{
+  if (self->coef != NULL)
+    free(self->coef);
+
+  free(self);
+}
+
+gf2_poly_t *
+gf2_poly_new(void)
+{
+  gf2_poly_t *self = NULL;
+
+  ALLOCATE(self, gf2_poly_t);
+
+  return self;
+
+fail:
+  return NULL;
+}
+
+static BOOL
+gf2_poly_reserve(gf2_poly_t *self, unsigned int words)
+{
+  uint64_t *coef;
+
+  if (words <= self->alloc)
+    return TRUE;
+
+  TRY(coef = realloc(self->coef, words * sizeof(uint64_t)));
+
+  self->coef  = coef;
+  self->alloc = words;
+
+  return TRUE;
+
+fail:
+  return FALSE;
+}
+
+static void
+gf2_poly_normalize(gf2_poly_t *self)
+{
+  while (self->words > 0 && self->coef[self->words - 1] == 0)
+    --self->words;
+}
+
+/* Replace the contents of self by a buffer of words */
+static void
+gf2_poly_assign(gf2_poly_t *self, uint64_t *coef, unsigned int words)
+{
+  if (self->coef != NULL)
+    free(self->coef);
+
+  self->coef  = coef;
+  self->words = words;
+  self->alloc = words;
+
+  gf2_poly_normalize(self);
+}
+
+void
+gf2_poly_set_zero(gf2_poly_t *self)
+{
+  self->words = 0;
+}
+
+BOOL
+gf2_poly_set_word(gf2_poly_t *self, uint64_t word)
+{
+  TRY(gf2_poly_reserve(self, 1));
+
+  self->coef[0] = word;
+  self->words   = 1;
+
+  gf2_poly_normalize(self);
+
+  return TRUE;
+
+fail:
+  return FALSE;
+}
+
+BOOL
+gf2_poly_set_coef(gf2_poly_t *self, unsigned int i, uint8_t bit)
+{
+  unsigned int word = i >> 6;
+
+  if (word >= self->words) {
+    if ((bit & 1) == 0)
+      return TRUE;
+
+    TRY(gf2_poly_reserve(self, word + 1));
+    memset(
+        self->coef + self->words,
+        0,
+        (word + 1 - self->words) * sizeof(uint64_t));
+    self->words = word + 1;
+  }
+
+  self->coef[word] =
+      (self->coef[word] & ~(1ull << (i & 63)))
+      | ((uint64_t) (bit & 1) << (i & 63));
+
+  gf2_poly_normalize(self);
+
+  return TRUE;
+
+fail:
+  return FALSE;
+}
+
+BOOL
+gf2_poly_copy(gf2_poly_t *dest, const gf2_poly_t *orig)
+{
+  if (dest == orig)
+    return TRUE;
+
+  TRY(gf2_poly_reserve(dest, orig->words));
+
+  if (orig->words > 0)
+    memcpy(dest->coef, orig->coef, orig->words * sizeof(uint64_t));
+
+  dest->words = orig->words;
+
+  return TRUE;
+
+fail:
+  return FALSE;
+}
+
+gf2_poly_t *
+gf2_poly_dup(const gf2_poly_t *orig)
+{
+  gf2_poly_t *self = NULL;
+
+  CONSTRUCT(self, gf2_poly);
+  TRY(gf2_poly_copy(self, orig));
+
+  return self;
+
+fail:
+  if (self != NULL)
+    gf2_poly_destroy(self);
+
+  return NULL;
+}
+
+/****************************** Arithmetic **********************************/
+BOOL
+gf2_poly_add(gf2_poly_t *dest, const gf2_poly_t *a, const gf2_poly_t *b)
+{
+  unsigned int na = a->words, nb = b->words;
+  unsigned int words = MAX(na, nb);
+  unsigned int i;
+  uint64_t x;
+
+  TRY(gf2_poly_reserve(dest, words));
+
+  /* Word i only depends on word i of the inputs, so aliasing is fine */
+  for (i = 0; i < words; ++i) {
+    x  = i < na ? a->coef[i] : 0;
+    x ^= i < nb ? b->coef[i] : 0;
+    dest->coef[i] = x;
+  }
+
+  dest->words = words;
+  gf2_poly_normalize(dest);
+
+  return TRUE;
+
+fail:
+  return FALSE;
+}
+
+BOOL
+gf2_poly_mul(gf2_poly_t *dest, const gf2_poly_t *a, const gf2_poly_t *b)
+{
+  gf2_poly_clmul_func_t clmul = gf2_poly_get_clmul();
+  uint64_t *prod = NULL;
+  uint64_t lo, hi;
+  unsigned int words, i, j;
+
+  if (gf2_poly_is_zero(a) || gf2_poly_is_zero(b)) {
+    gf2_poly_set_zero(dest);
+    return TRUE;
+  }
+
+  words = a->words + b->words;
+
+  ALLOCATE_MANY(prod, words, uint64_t);
+
+  for (i = 0; i < a->words; ++i)
+    for (j = 0; j < b->words; ++j) {
+      lo = (clmul) (a->coef[i], b->coef[j], &hi);
+      prod[i + j]     ^= lo;
+      prod[i + j + 1] ^= hi;
+    }
+
+  gf2_poly_assign(dest, prod, words);
+
+  return TRUE;
+
+fail:
+  return FALSE;
+}
+
+/* r += b * x^shift, r must have room for it */
+static void
+gf2_poly_add_shifted(uint64_t *r, const gf2_poly_t *b, unsigned int shift)
+{
+  unsigned int off = shift >> 6;
+  unsigned int bits = shift & 63;
+  unsigned int i;
+
+  for (i = 0; i < b->words; ++i) {
+    r[i + off] ^= b->coef[i] << bits;
+    if (bits != 0)
+      r[i + off + 1] ^= b->coef[i] >> (64 - bits);
+  }
+}
+
+BOOL
+gf2_poly_divmod(
+    gf2_poly_t *q,
+    gf2_poly_t *r,
+    const gf2_poly_t *a,
+    const gf2_poly_t *b)
+{
+  uint64_t *rem = NULL;
+  uint64_t *quot = NULL;
+  unsigned int words, size;
+  int deg_b = gf2_poly_get_degree(b);
+  int deg_r;
+  unsigned int shift;
+  BOOL ok = FALSE;
+
+  TRY(deg_b >= 0);
+
+  /* One extra word absorbs the spill of the shifted divisor */
+  size = words = a->words + 1;
+
+  ALLOCATE_MANY(rem, size, uint64_t);
+  ALLOCATE_MANY(quot, size, uint64_t);
+
+  if (a->words > 0)
+    memcpy(rem, a->coef, a->words * sizeof(uint64_t));
+
+  for (;;) {
+    deg_r = -1;
+    while (words > 0 && rem[words - 1] == 0)
+      --words;
+
+    if (words > 0)
+      deg_r = ((words - 1) << 6) + 63 - __builtin_clzll(rem[words - 1]);
+
+    if (deg_r < deg_b)
+      break;
+
+    shift = deg_r - deg_b;
+    quot[shift >> 6] |= 1ull << (shift & 63);
+    gf2_poly_add_shifted(rem, b, shift);
+  }
+
+  if (q != NULL) {
+    gf2_poly_assign(q, quot, size);
+    quot = NULL;
+  }
+
+  if (r != NULL) {
+    gf2_poly_assign(r, rem, size);
+    rem = NULL;
+  }
+
+  ok = TRUE;
+
+fail:
+  if (rem != NULL)
+    free(rem);
+
+  if (quot != NULL)
+    free(quot);
+
+  return ok;
+}
+
+BOOL
+gf2_poly_gcd(gf2_poly_t *dest, const gf2_poly_t *a, const gf2_poly_t *b)
+{
+  gf2_poly_t *x = NULL;
+  gf2_poly_t *y = NULL;
+  gf2_poly_t *tmp;
+  BOOL ok = FALSE;
+
+  TRY(x = gf2_poly_dup(a));
+  TRY(y = gf2_poly_dup(b));
+
+  while (!gf2_poly_is_zero(y)) {
+    TRY(gf2_poly_divmod(NULL, x, x, y));
+    tmp = x;
+    x = y;
+    y = tmp;
+  }
+
+  TRY(gf2_poly_copy(dest, x));
+
+  ok = TRUE;
+
+fail:
+  if (x != NULL)
+    gf2_poly_destroy(x);
+
+  if (y != NULL)
+    gf2_poly_destroy(y);
+
+  return ok;
+}
+
+/*************************** Polynomial matrices ****************************/
+/*
+ * Fraction-free (Bareiss) elimination. Every division is exact, and
+ * signs do not matter in characteristic 2.
+ */
+BOOL
+gf2_poly_det(gf2_poly_t *dest, gf2_poly_t *const *matrix, unsigned int size)
+{
+  gf2_poly_t **m = NULL;
+  gf2_poly_t *prev = NULL;
+  gf2_poly_t *prod = NULL;
+  gf2_poly_t *tmp;
+  unsigned int i, j, k, p;
+  BOOL ok = FALSE;
+
+  if (size == 0)
+    return gf2_poly_set_word(dest, 1);
+
+  ALLOCATE_MANY(m, size * size, gf2_poly_t *);
+
+  for (i = 0; i < size * size; ++i)
+    TRY(m[i] = gf2_poly_dup(matrix[i]));
+
+  CONSTRUCT(prod, gf2_poly);
+  CONSTRUCT(prev, gf2_poly);
+  TRY(gf2_poly_set_word(prev, 1));
+
+  for (k = 0; k + 1 < size; ++k) {
+    if (gf2_poly_is_zero(m[k * size + k])) {
+      for (p = k + 1; p < size; ++p)
+        if (!gf2_poly_is_zero(m[p * size + k]))
+          break;
+
+      if (p == size) {
+        gf2_poly_set_zero(dest);
+        ok = TRUE;
+        goto fail;
+      }
+
+      for (j = 0; j < size; ++j) {
+        tmp = m[k * size + j];
+        m[k * size + j] = m[p * size + j];
+        m[p * size + j] = tmp;
+      }
+    }
+
+    for (i = k + 1; i < size; ++i) {
+      for (j = k + 1; j < size; ++j) {
+        TRY(gf2_poly_mul(m[i * size + j], m[i * size + j], m[k * size + k]));
+        TRY(gf2_poly_mul(prod, m[i * size + k], m[k * size + j]));
+        TRY(gf2_poly_add(m[i * size + j], m[i * size + j], prod));
+        TRY(gf2_poly_divmod(m[i * size + j], NULL, m[i * size + j], prev));
+      }
+    }
+
+    TRY(gf2_poly_copy(prev, m[k * size + k]));
+  }
+
+  TRY(gf2_poly_copy(dest, m[size * size - 1]));
+
+  ok = TRUE;
+
+fail:
+  if (m != NULL) {
+    for (i = 0; i < size * size; ++i)
+      if (m[i] != NULL)
+        gf2_poly_destroy(m[i]);
+
+    free(m);
+  }
+
+  if (prev != NULL)
+    gf2_poly_destroy(prev);
+
+  if (prod != NULL)
+    gf2_poly_destroy(prod);
+
+  return ok;
+}
+
+BOOL
+gf2_poly_kernel(gf2_poly_t **g, gf2_poly_t *const *h, unsigned int cols)
+{
+  gf2_poly_t **minor = NULL;
+  gf2_poly_t *content = NULL;
+  unsigned int rows = cols - 1;
+  unsigned int i, j, c, q;
+  BOOL ok = FALSE;
+
+  TRY(cols > 0);
+
+  ALLOCATE_MANY(minor, rows * rows + 1, gf2_poly_t *);
+  CONSTRUCT(content, gf2_poly);
+
+  /* g[j] is the minor obtained by removing column j */
+  for (j = 0; j < cols; ++j) {
+    for (i = 0; i < rows; ++i)
+      for (c = 0, q = 0; c < cols; ++c)
+        if (c != j)
+          minor[i * rows + q++] = h[i * cols + c];
+
+    TRY(gf2_poly_det(g[j], minor, rows));
+    TRY(gf2_poly_gcd(content, content, g[j]));
+  }
+
+  if (!gf2_poly_is_zero(content))
+    for (j = 0; j < cols; ++j)
+      TRY(gf2_poly_divmod(g[j], NULL, g[j], content));
+
+  ok = TRUE;
+
+fail:
+  if (minor != NULL)
+    free(minor);
+
+  if (content != NULL)
+    gf2_poly_destroy(content);
+
+  return ok;
+}
@@ -0,0 +1,115 @@
+/*
+  gf2poly.h: GF(2)[x] polynomial arithmetic
+
+  Copyright (C) 2019 Gonzalo José Carracedo Carballal
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this program.  If not, see
+  <http://www.gnu.org/licenses/>
+
+*/
+
+#ifndef _GF2_GF2POLY_H
+#define _GF2_GF2POLY_H
+
+#include <stdint.h>
+#include <defs.h>
+
+/*
+ * Polynomials over GF(2) of arbitrary degree. Coefficient i is bit
+ * (i & 63) of word (i >> 6). Polynomials are kept normalized: the top
+ * used word is never zero, and the zero polynomial has no words.
+ */
+struct gf2_poly {
+  uint64_t *coef;
+  unsigned int words;
+  unsigned int alloc;
+};
+
+typedef struct gf2_poly gf2_poly_t;
+
+static inline BOOL
+gf2_poly_is_zero(const gf2_poly_t *self)
+{
+  return self->words == 0;
+}
+
+/* -1 for the zero polynomial */
+static inline int
+gf2_poly_get_degree(const gf2_poly_t *self)
+{
+  if (self->words == 0)
+    return -1;
+
+  return ((self->words - 1) << 6) + 63
+      - __builtin_clzll(self->coef[self->words - 1]);
+}
+
+static inline uint8_t
+gf2_poly_get_coef(const gf2_poly_t *self, unsigned int i)
+{
+  if ((i >> 6) >= self->words)
+    return 0;
+
+  return (self->coef[i >> 6] >> (i & 63)) & 1;
+}
+
+/* Lowest 64 coefficients */
+static inline uint64_t
+gf2_poly_get_word(const gf2_poly_t *self)
+{
+  return self->words > 0 ? self->coef[0] : 0;
+}
+
+/* 64x64 -> 128 bit carry-less product. Uses PCLMULQDQ if available */
+uint64_t gf2_poly_clmul(uint64_t a, uint64_t b, uint64_t *hi);
+
+void gf2_poly_destroy(gf2_poly_t *self);
+gf2_poly_t *gf2_poly_new(void);
+gf2_poly_t *gf2_poly_dup(const gf2_poly_t *orig);
+
+void gf2_poly_set_zero(gf2_poly_t *self);
+BOOL gf2_poly_set_word(gf2_poly_t *self, uint64_t word);
+BOOL gf2_poly_set_coef(gf2_poly_t *self, unsigned int i, uint8_t bit);
+BOOL gf2_poly_copy(gf2_poly_t *dest, const gf2_poly_t *orig);
+
+/* Output arguments may alias the inputs */
+BOOL gf2_poly_add(gf2_poly_t *dest, const gf2_poly_t *a, const gf2_poly_t *b);
+BOOL gf2_poly_mul(gf2_poly_t *dest, const gf2_poly_t *a, const gf2_poly_t *b);
+
+/* a = q * b + r. Either q or r may be NULL. b must not be zero */
+BOOL gf2_poly_divmod(
+    gf2_poly_t *q,
+    gf2_poly_t *r,
+    const gf2_poly_t *a,
+    const gf2_poly_t *b);
+
+BOOL gf2_poly_gcd(gf2_poly_t *dest, const gf2_poly_t *a, const gf2_poly_t *b);
+
+/* Determinant of a size x size matrix of polynomials, given by rows */
+BOOL gf2_poly_det(
+    gf2_poly_t *dest,
+    gf2_poly_t *const *matrix,
+    unsigned int size);
+
+/*
+ * Kernel of a (cols - 1) x cols polynomial matrix h: the vector g of
+ * maximal minors, divided by their GCD, so that h * g^T = 0. g is left
+ * all zero if h is rank deficient.
+ */
+BOOL gf2_poly_kernel(
+    gf2_poly_t **g,
+    gf2_poly_t *const *h,
+    unsigned int cols);
+
+#endif /* _GF2_GF2POLY_H */
@@ -30,6 +30,9 @@ struct gf2_matrix {
   unsigned int blocks;
   unsigned int rank;
   uint64_t **row_data;
+  uint64_t *slab; /* All rows live here, row_data points inside */
+  BOOL huge;      /* Slab backed by huge pages, if big enough */
+  uint64_t *pivots; /* Set by elimination: columns (or rows) with a pivot */
 };
 
 typedef struct gf2_matrix gf2_matrix_t;
@@ -38,6 +41,8 @@ typedef struct gf2_matrix gf2_matrix_t;
 #define GF2_MATRIX_ROW_BLOCKS(n) GF2_MATRIX_ROW_BLOCK((n) + 63)
 #define GF2_MATRIX_ROW_SHIFT(n) (((n) & 63))
 
+/* Bits must be widened to uint64_t before shifting: offsets go up to 63 */
+
 static inline void
 gf2_matrix_set(
     gf2_matrix_t *self,
@@ -55,7 +60,7 @@ gf2_matrix_set(
   bit &= 1;
 
   self->row_data[row][block] =
-      (mask & self->row_data[row][block]) | (bit << off);
+      (mask & self->row_data[row][block]) | ((uint64_t) bit << off);
 }
 
 static inline void
@@ -71,7 +76,7 @@ gf2_matrix_add(
   assert(row < self->rows);
   assert(col < self->cols);
 
-  self->row_data[row][block] ^= bit << off;
+  self->row_data[row][block] ^= (uint64_t) bit << off;
 }
 
 static inline uint8_t
@@ -138,10 +143,46 @@ gf2_matrix_row_is_null(const gf2_matrix_t *self, unsigned int row)
   return TRUE;
 }
 
+/* Whether column (or row) i got a pivot in the last elimination */
+static inline BOOL
+gf2_matrix_has_pivot(const gf2_matrix_t *self, unsigned int i)
+{
+  assert(self->pivots != NULL);
+
+  return (self->pivots[GF2_MATRIX_ROW_BLOCK(i)] >> GF2_MATRIX_ROW_SHIFT(i)) & 1;
+}
+
+/*
+ * Whether a column is null after gf2_matrix_gauss_jordan_cols(). Only
+ * rows of earlier columns with no pivot can still have bits in a column
+ * with no pivot, so just those are looked at.
+ */
+static inline BOOL
+gf2_matrix_col_is_free(const gf2_matrix_t *self, unsigned int col)
+{
+  unsigned int i;
+
+  assert(col < self->cols);
+
+  if (gf2_matrix_has_pivot(self, col))
+    return FALSE;
+
+  for (i = 0; i < col; ++i)
+    if (!gf2_matrix_has_pivot(self, i) && gf2_matrix_get(self, i, col))
+      return FALSE;
+
+  return TRUE;
+}
+
 void gf2_matrix_destroy(gf2_matrix_t *self);
-gf2_matrix_t *gf2_matrix_new(unsigned int rows, unsigned int cols);
+gf2_matrix_t *gf2_matrix_new(unsigned int rows, unsigned int cols, BOOL huge);
 gf2_matrix_t *gf2_matrix_eye(unsigned int rows, unsigned int cols);
 gf2_matrix_t *gf2_matrix_transpose(const gf2_matrix_t *mat);
+void gf2_matrix_load_row(
+    gf2_matrix_t *self,
+    unsigned int row,
+    const uint64_t *packed,
+    uint64_t offset);
 void gf2_matrix_swap_rows(gf2_matrix_t *self, unsigned int a, unsigned int b);
 void gf2_matrix_add_rows(gf2_matrix_t *self, unsigned int a, unsigned int b);
 void gf2_matrix_swap_cols(gf2_matrix_t *self, unsigned int a, unsigned int b);
@@ -151,5 +192,23 @@ uint8_t *gf2_matrix_copy_row(const gf2_matrix_t *self, unsigned int row);
 uint8_t *gf2_matrix_copy_col(const gf2_matrix_t *self, unsigned int col);
 BOOL gf2_matrix_gauss_jordan_rows(gf2_matrix_t *self, gf2_matrix_t **b);
 BOOL gf2_matrix_gauss_jordan_cols(gf2_matrix_t *self, gf2_matrix_t **b);
+BOOL gf2_matrix_gauss_jordan_cols_mt(
+    gf2_matrix_t *self,
+    gf2_matrix_t **b,
+    unsigned int threads);
+unsigned int gf2_matrix_null_space(
+    const gf2_matrix_t *self,
+    const gf2_matrix_t *b,
+    uint64_t *basis);
+unsigned int gf2_matrix_rref(gf2_matrix_t *self);
+gf2_matrix_t *gf2_matrix_kernel(
+    const gf2_matrix_t *self,
+    const gf2_matrix_t *b,
+    BOOL reduced);
+BOOL gf2_matrix_sketch_is_deficient(
+    const gf2_matrix_t *self,
+    unsigned int oversample,
+    uint64_t seed,
+    BOOL *deficient);
 
 #endif /* _GF2_GF2TYPES_H */
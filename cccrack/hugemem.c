@@ -0,0 +1,141 @@
+/*
+  hugemem.c: Huge page backed memory
+
+  Copyright (C) 2019 Gonzalo José Carracedo Carballal
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this program.  If not, see
+  <http://www.gnu.org/licenses/>
+
+*/
+
+#include <sys/mman.h>
+#include <unistd.h>
+#include <string.h>
+
+#include "hugemem.h"
+
+/*
+ * Every block is preceded by a header recording how it was allocated,
+ * so that hugemem_free does not depend on the policy at free time.
+ */
+#define HUGEMEM_HEADER_SIZE 64
+
+enum hugemem_kind {
+  HUGEMEM_KIND_HEAP,
+  HUGEMEM_KIND_MMAP
+};
+
+struct hugemem_header {
+  enum hugemem_kind kind;
+  size_t size; /* Total size, including header */
+};
+
+static void
+hugemem_prefault(void *base, size_t size)
+{
+  size_t page_size = getpagesize();
+  volatile uint8_t *bytes = base;
+  size_t i;
+
+#ifdef MADV_POPULATE_WRITE
+  if (madvise(base, size, MADV_POPULATE_WRITE) == 0)
+    return;
+#endif /* MADV_POPULATE_WRITE */
+
+  for (i = 0; i < size; i += page_size)
+    bytes[i] = 0;
+}
+
+static void *
+hugemem_map(size_t size)
+{
+  void *base;
+
+#ifdef MAP_HUGETLB
+  /* Explicit huge pages first. These are usually reserved by the admin */
+  base = mmap(
+      NULL,
+      size,
+      PROT_READ | PROT_WRITE,
+      MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_POPULATE,
+      -1,
+      0);
+
+  if (base != MAP_FAILED)
+    return base;
+#endif /* MAP_HUGETLB */
+
+  /* Fall back to transparent huge pages */
+  base = mmap(
+      NULL,
+      size,
+      PROT_READ | PROT_WRITE,
+      MAP_PRIVATE | MAP_ANONYMOUS,
+      -1,
+      0);
+
+  if (base == MAP_FAILED)
+    return NULL;
+
+#ifdef MADV_HUGEPAGE
+  (void) madvise(base, size, MADV_HUGEPAGE);
+#endif /* MADV_HUGEPAGE */
+
+  hugemem_prefault(base, size);
+
+  return base;
+}
+
+/* Returns zeroed memory, like calloc */
+void *
+hugemem_alloc(size_t size, BOOL huge)
+{
+  struct hugemem_header *header = NULL;
+  size_t total = size + HUGEMEM_HEADER_SIZE;
+
+  if (huge && total >= HUGEMEM_MIN_SIZE) {
+    total = ((total + HUGEMEM_PAGE_SIZE - 1) / HUGEMEM_PAGE_SIZE)
+        * HUGEMEM_PAGE_SIZE;
+
+    if ((header = hugemem_map(total)) != NULL)
+      header->kind = HUGEMEM_KIND_MMAP;
+  }
+
+  if (header == NULL) {
+    if ((header = calloc(1, total)) == NULL)
+      return NULL;
+
+    header->kind = HUGEMEM_KIND_HEAP;
+  }
+
+  header->size = total;
+
+  return (uint8_t *) header + HUGEMEM_HEADER_SIZE;
+}
+
+void
+hugemem_free(void *ptr)
+{
+  struct hugemem_header *header;
+
+  if (ptr == NULL)
+    return;
+
+  header = (struct hugemem_header *) ((uint8_t *) ptr - HUGEMEM_HEADER_SIZE);
+
+  if (header->kind == HUGEMEM_KIND_MMAP)
+    munmap(header, header->size);
+  else
+    free(header);
+}
@@ -0,0 +1,38 @@
+/*
+  hugemem.h: Huge page backed memory
+
+  Copyright (C) 2019 Gonzalo José Carracedo Carballal
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this program.  If not, see
+  <http://www.gnu.org/licenses/>
+
+*/
+
+#ifndef _HUGEMEM_H
+#define _HUGEMEM_H
+
+#include <stdint.h>
+#include <defs.h>
+
+/*
+ * Allocations smaller than this are always served by calloc. Bigger ones
+ * are backed by huge pages (if asked to) and pre-faulted.
+ */
+#define HUGEMEM_PAGE_SIZE (2ull << 20)
+#define HUGEMEM_MIN_SIZE  HUGEMEM_PAGE_SIZE
+
+void *hugemem_alloc(size_t size, BOOL huge);
+void  hugemem_free(void *ptr);
+
+#endif /* _HUGEMEM_H */
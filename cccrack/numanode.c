@@ -0,0 +1,186 @@
+/*
+  numanode.c: Minimal NUMA helpers
+
+  Copyright (C) 2019 Gonzalo José Carracedo Carballal
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this program.  If not, see
+  <http://www.gnu.org/licenses/>
+
+*/
+
+#define _GNU_SOURCE
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdio.h>
+
+#include "numanode.h"
+
+#define NUMANODE_SYSFS_PATH "/sys/devices/system/node"
+
+/*
+ * MPOL_BIND is an enum constant in <linux/mempolicy.h>, not a macro, so
+ * it cannot be tested with the preprocessor. Its value is part of the
+ * kernel ABI.
+ */
+#define NUMANODE_MPOL_BIND 2
+
+/* Parse lists like "0-3,8-11" and call `cb' for every element */
+static BOOL
+numanode_parse_list(
+    const char *path,
+    void (*cb) (void *private, unsigned int value),
+    void *private)
+{
+  FILE *fp = NULL;
+  unsigned int first, last;
+  int c;
+  BOOL ok = FALSE;
+
+  if ((fp = fopen(path, "r")) == NULL)
+    goto fail;
+
+  while (fscanf(fp, "%u", &first) == 1) {
+    last = first;
+
+    if ((c = fgetc(fp)) == '-') {
+      if (fscanf(fp, "%u", &last) != 1)
+        goto fail;
+      c = fgetc(fp);
+    }
+
+    while (first <= last)
+      (cb) (private, first++);
+
+    if (c != ',')
+      break;
+  }
+
+  ok = TRUE;
+
+fail:
+  if (fp != NULL)
+    fclose(fp);
+
+  return ok;
+}
+
+static void
+numanode_count_cb(void *private, unsigned int value)
+{
+  unsigned int *count = (unsigned int *) private;
+
+  if (value + 1 > *count)
+    *count = value + 1;
+}
+
+unsigned int
+numanode_get_count(void)
+{
+  unsigned int count = 0;
+
+  if (!numanode_parse_list(
+      NUMANODE_SYSFS_PATH "/online",
+      numanode_count_cb,
+      &count))
+    return 1;
+
+  if (count == 0)
+    return 1;
+
+  return MIN(count, NUMANODE_MAX_NODES);
+}
+
+static void
+numanode_cpuset_cb(void *private, unsigned int value)
+{
+  cpu_set_t *set = (cpu_set_t *) private;
+
+  if (value < CPU_SETSIZE)
+    CPU_SET(value, set);
+}
+
+/* Restrict the calling thread to the CPUs of a node */
+BOOL
+numanode_bind_thread(unsigned int node)
+{
+  char path[64];
+  cpu_set_t set;
+
+  CPU_ZERO(&set);
+
+  snprintf(path, sizeof(path), NUMANODE_SYSFS_PATH "/node%u/cpulist", node);
+
+  if (!numanode_parse_list(path, numanode_cpuset_cb, &set))
+    return FALSE;
+
+  if (CPU_COUNT(&set) == 0)
+    return FALSE;
+
+  return sched_setaffinity(0, sizeof(cpu_set_t), &set) == 0;
+}
+
+/*
+ * Anonymous memory bound to a node. If binding is not possible, the
+ * memory is still returned, `*bound' is set to FALSE and pages land
+ * wherever first-touch puts them.
+ */
+void *
+numanode_alloc(size_t size, unsigned int node, BOOL *bound)
+{
+  void *base;
+#ifdef __NR_mbind
+  unsigned long mask;
+#endif /* __NR_mbind */
+
+  *bound = FALSE;
+
+  base = mmap(
+      NULL,
+      size,
+      PROT_READ | PROT_WRITE,
+      MAP_PRIVATE | MAP_ANONYMOUS,
+      -1,
+      0);
+
+  if (base == MAP_FAILED)
+    return NULL;
+
+#ifdef __NR_mbind
+  if (node < 8 * sizeof(unsigned long)) {
+    mask = 1ul << node;
+    *bound = syscall(
+        __NR_mbind,
+        base,
+        size,
+        NUMANODE_MPOL_BIND,
+        &mask,
+        8 * sizeof(unsigned long) + 1, /* The kernel reads maxnode - 1 bits */
+        0) == 0;
+  }
+#else
+  (void) node;
+#endif /* __NR_mbind */
+
+  return base;
+}
+
+void
+numanode_free(void *ptr, size_t size)
+{
+  if (ptr != NULL)
+    munmap(ptr, size);
+}
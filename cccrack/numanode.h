@@ -0,0 +1,40 @@
+/*
+  numanode.h: Minimal NUMA helpers
+
+  Copyright (C) 2019 Gonzalo José Carracedo Carballal
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this program.  If not, see
+  <http://www.gnu.org/licenses/>
+
+*/
+
+#ifndef _NUMANODE_H
+#define _NUMANODE_H
+
+#include <stdint.h>
+#include <defs.h>
+
+/*
+ * Thin layer on top of sysfs and the mbind syscall, so that we do not
+ * depend on libnuma. On non-NUMA systems everything behaves as if there
+ * was a single node.
+ */
+#define NUMANODE_MAX_NODES 64
+
+unsigned int numanode_get_count(void);
+BOOL numanode_bind_thread(unsigned int node);
+void *numanode_alloc(size_t size, unsigned int node, BOOL *bound);
+void numanode_free(void *ptr, size_t size);
+
+#endif /* _NUMANODE_H */
@@ -26,8 +26,10 @@
 #include <string.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <assert.h>
 
 #include "symtag.h"
+#include "hugemem.h"
 
 void
 tagging_finalize(struct tagging *self)
@@ -159,25 +161,240 @@ tagging_compute_properties(struct tagging *self)
   self->is_gray = is_gray;
 }
 
+/*
+ * Taggings are enumerated in lexicographic order of their dictionaries,
+ * so the dictionary of a tagging ID is given by its factorial number
+ * system representation.
+ */
+void
+tagging_set_id(struct tagging *self, uint64_t id)
+{
+  unsigned int len = self->dict_len;
+  unsigned int sym, i, digit;
+  uint64_t used = 0;
+  uint64_t fact;
+
+  assert(id < tagging_get_count(self));
+
+  self->tagging_id = id;
+
+  for (sym = 0; sym < len; ++sym) {
+    /* (len - sym - 1)!, saturated */
+    fact = 1;
+    for (i = 2; i < len - sym && fact <= id; ++i)
+      fact *= i;
+
+    digit = id / fact;
+    id   %= fact;
+
+    for (i = 0; i < len; ++i)
+      if ((used & (1ull << i)) == 0 && digit-- == 0)
+        break;
+
+    used |= 1ull << i;
+    self->dict[sym] = i;
+  }
+
+  tagging_compute_properties(self);
+}
+
+BOOL
+tagging_init(struct tagging *self, unsigned int bps, uint64_t id)
+{
+  struct tagging tagging = tagging_INITIALIZER;
+
+  tagging.bps = bps;
+  tagging.mask = (1 << bps) - 1;
+  tagging.dict_len = 1 << bps;
+
+  ALLOCATE_MANY(tagging.dict, tagging.dict_len, uint8_t);
+
+  tagging_set_id(&tagging, id);
+
+  *self = tagging;
+
+  return TRUE;
+
+fail:
+  return FALSE;
+}
+
+/******************************* Window mapper ******************************/
+static void
+symtag_window_unmap(struct symtag_window *self)
+{
+  if (self->base != NULL && self->buffer == NULL)
+    munmap(self->base, self->size);
+
+  self->base = NULL;
+}
+
+static void
+symtag_window_finalize(struct symtag_window *self)
+{
+  symtag_window_unmap(self);
+
+  if (self->fd != -1)
+    close(self->fd);
+
+  self->fd = -1;
+}
+
+static void
+symtag_window_init(struct symtag_window *self, int fd, uint64_t file_len)
+{
+  memset(self, 0, sizeof(struct symtag_window));
+
+  self->fd = fd;
+  self->file_len = file_len;
+}
+
+static void
+symtag_window_init_buffer(
+    struct symtag_window *self,
+    const uint8_t *buffer,
+    uint64_t len)
+{
+  symtag_window_init(self, -1, len);
+
+  self->buffer = buffer;
+}
+
+static BOOL
+symtag_window_is_sliding(const struct symtag_window *self)
+{
+  return self->buffer == NULL && self->file_len > SYMTAG_WINDOW_SIZE;
+}
+
+/*
+ * Return a pointer to the symbol at file offset `off', sliding the
+ * window if necessary. The number of symbols that can be read
+ * from the returned pointer is stored in `avail'.
+ */
+static const uint8_t *
+symtag_window_get(struct symtag_window *self, uint64_t off, uint64_t *avail)
+{
+  uint64_t page_size = getpagesize();
+  uint64_t start;
+  size_t size;
+  void *base;
+
+  assert(off < self->file_len);
+
+  if (self->buffer != NULL) {
+    *avail = self->file_len - off;
+    return self->buffer + off;
+  }
+
+  if (self->base == NULL
+      || off < self->offset
+      || off >= self->offset + self->size) {
+    start = (off / page_size) * page_size;
+    size  = MIN(SYMTAG_WINDOW_SIZE, self->file_len - start);
+
+    if (self->base != NULL) {
+      munmap(self->base, self->size);
+      self->base = NULL;
+    }
+
+    if ((base = mmap(
+        NULL,
+        size,
+        PROT_READ,
+        MAP_PRIVATE | (self->huge ? MAP_POPULATE : 0),
+        self->fd,
+        start)) == MAP_FAILED) {
+      ERROR(
+          "Cannot map %lu bytes at offset %llu: %s\n",
+          (unsigned long) size,
+          (unsigned long long) start,
+          strerror(errno));
+      return NULL;
+    }
+
+    if (symtag_window_is_sliding(self))
+      (void) madvise(base, size, MADV_SEQUENTIAL);
+
+#ifdef MADV_HUGEPAGE
+    /* Only honored by filesystems supporting read-only file THPs */
+    if (self->huge)
+      (void) madvise(base, size, MADV_HUGEPAGE);
+#endif /* MADV_HUGEPAGE */
+
+    self->base     = base;
+    self->offset   = start;
+    self->size     = size;
+    self->released = start;
+  }
+
+  *avail = self->offset + self->size - off;
+
+  return self->base + (off - self->offset);
+}
+
+/*
+ * Tell the kernel that we are not going to need the pages behind `off'
+ * anymore. Only makes sense if the window actually slides.
+ */
+static void
+symtag_window_release(struct symtag_window *self, uint64_t off)
+{
+  uint64_t page_size = getpagesize();
+  uint64_t end;
+
+  if (!symtag_window_is_sliding(self) || self->base == NULL)
+    return;
+
+  if (off > self->offset + self->size)
+    off = self->offset + self->size;
+
+  end = (off / page_size) * page_size;
+
+  if (end > self->released) {
+    (void) madvise(
+        self->base + (self->released - self->offset),
+        end - self->released,
+        MADV_DONTNEED);
+    self->released = end;
+  }
+}
+
+/********************************* Symtag **********************************/
+static void
+symtag_free_replicas(symtag_t *self)
+{
+  unsigned int i;
+
+  for (i = 0; i < self->replica_count; ++i)
+    numanode_free(self->replica_list[i], self->sym_len);
+
+  self->replica_count = 0;
+}
+
 void
 symtag_destroy(symtag_t *self)
 {
-  if (self->sym_data != NULL && self->sym_data != (void *) -1)
-    munmap(self->sym_data, self->sym_len);
+  symtag_window_finalize(&self->window);
+
+  symtag_free_replicas(self);
 
   if (self->tagging.dict != NULL)
     free(self->tagging.dict);
 
-  if (self->bit_data != NULL)
-    free(self->bit_data);
+  if (self->rel_data != NULL)
+    free(self->rel_data);
+
+  if (self->release != NULL)
+    (self->release) (self->release_private, self->buffer, self->buffer_len);
 
   free(self);
 }
 
+/* Takes ownership of the window, even on failure */
 static symtag_t *
 symtag_new(
-    uint8_t *sym_data,
-    size_t len,
+    struct symtag_window *window,
+    uint64_t len,
     unsigned int bps,
     symtag_tagging_cb_t cb,
     void *private)
@@ -186,22 +403,15 @@ symtag_new(
 
   ALLOCATE(self, symtag_t);
 
-  self->sym_data = sym_data;
+  self->window = *window;
+  symtag_window_init(window, -1, 0);
+
   self->sym_len  = len;
   self->bit_len  = len * bps;
   self->tagging.bps = bps;
   self->tagging.mask = (1 << bps) - 1;
   self->tagging.dict_len = 1 << bps;
-
-  ALLOCATE_MANY(
-      self->tagging.dict,
-      self->tagging.dict_len,
-      uint8_t);
-
-  ALLOCATE_MANY(
-      self->bit_data,
-      self->bit_len,
-      uint8_t);
+  self->threads = 1;
 
   self->private = private;
   self->on_tagging = cb;
@@ -211,10 +421,67 @@ symtag_new(
 fail:
   if (self != NULL)
     symtag_destroy(self);
+  else
+    symtag_window_finalize(window);
 
   return NULL;
 }
 
+/*
+ * Find the valid prefix of the capture and the number of bits per
+ * symbol needed to represent it.
+ */
+static BOOL
+symtag_scan_capture(
+    struct symtag_window *window,
+    uint64_t *valid,
+    unsigned int *bps)
+{
+  const uint8_t *sym_data;
+  uint64_t avail;
+  uint64_t i, j;
+  unsigned int sym;
+  unsigned int symcnt = 2;
+  BOOL done = FALSE;
+
+  *valid = 0;
+  *bps = 1;
+
+  for (i = 0; !done && i < window->file_len; i += avail) {
+    TRY(sym_data = symtag_window_get(window, i, &avail));
+
+    for (j = 0; j < avail; ++j) {
+      if (sym_data[j] < '0' || sym_data[j] >= '0' + 64) {
+        done = TRUE;
+        break;
+      }
+
+      sym = sym_data[j] - '0';
+      while (sym >= symcnt) {
+        ++*bps;
+        symcnt <<= 1;
+      }
+
+      ++*valid;
+    }
+
+    symtag_window_release(window, i + j);
+  }
+
+  if (*valid == 0) {
+    ERROR("This is not a valid symbol capture file\n");
+    goto fail;
+  }
+
+  /* Everything beyond the valid prefix is ignored */
+  window->file_len = *valid;
+
+  return TRUE;
+
+fail:
+  return FALSE;
+}
+
 symtag_t *
 symtag_new_from_file(
     const char *file,
@@ -222,17 +489,15 @@ symtag_new_from_file(
     symtag_tagging_cb_t cb,
     void *private)
 {
-  symtag_t *self = NULL;
-  uint8_t *sym_data = (uint8_t *) -1;
-  unsigned int sym_len;
-  unsigned int symcnt = 2;
-  unsigned int i;
-  unsigned int valid = 0;
-  unsigned int chop_start = 0;
-  unsigned int page_size;
+  struct symtag_window window;
+  uint64_t sym_len;
+  uint64_t valid;
+  unsigned int detected_bps;
 
   struct stat sbuf;
-  int fd;
+  int fd = -1;
+
+  symtag_window_init(&window, -1, 0);
 
   if (stat(file, &sbuf) == -1) {
     ERROR("Cannot stat `%s': %s\n", file, strerror(errno));
@@ -246,114 +511,476 @@ symtag_new_from_file(
 
   sym_len = sbuf.st_size;
 
-  TRY(
-      (sym_data = mmap(NULL, sym_len, PROT_READ, MAP_PRIVATE, fd, 0)) !=
-          (uint8_t *) -1);
+  if (sym_len == 0) {
+    ERROR("This is not a valid symbol capture file\n");
+    goto fail;
+  }
 
+  symtag_window_init(&window, fd, sym_len);
+  fd = -1;
 
-  close(fd);
+  TRY(symtag_scan_capture(&window, &valid, &detected_bps));
 
-  if (bps == 0) {
-    bps = 1;
-    for (i = 0; i < sym_len; ++i) {
-      if (sym_data[i] < '0' || sym_data[i] >= '0' + 64)
-        break;
+  if (bps == 0)
+    bps = detected_bps;
 
-      while ((sym_data[i] - '0') >= symcnt) {
-        ++bps;
-        symcnt <<= 1;
-      }
+  /* Window ownership is transferred to the tagger */
+  return symtag_new(&window, valid, bps, cb, private);
 
-      ++valid;
-    }
+fail:
+  symtag_window_finalize(&window);
+
+  if (fd != -1)
+    close(fd);
+
+  return NULL;
+}
+
+/*
+ * Zero-copy constructor. The buffer must remain valid until `release'
+ * is called, which happens when the tagger is destroyed or, if
+ * construction fails, before this function returns.
+ */
+symtag_t *
+symtag_new_from_buffer(
+    const uint8_t *data,
+    uint64_t len,
+    symtag_release_cb_t release,
+    void *release_private,
+    unsigned int bps,
+    symtag_tagging_cb_t cb,
+    void *private)
+{
+  symtag_t *self = NULL;
+  struct symtag_window window;
+  uint64_t valid;
+  unsigned int detected_bps;
+
+  symtag_window_init_buffer(&window, data, len);
+
+  if (len == 0) {
+    ERROR("This is not a valid symbol capture buffer\n");
+    goto fail;
   }
 
-  if (valid == 0) {
-    ERROR("This is not a valid symbol capture file\n");
+  TRY(symtag_scan_capture(&window, &valid, &detected_bps));
+
+  if (bps == 0)
+    bps = detected_bps;
+
+  TRY(self = symtag_new(&window, valid, bps, cb, private));
+
+  self->buffer = data;
+  self->buffer_len = len;
+  self->release = release;
+  self->release_private = release_private;
+
+  return self;
+
+fail:
+  if (release != NULL)
+    (release) (release_private, data, len);
+
+  return NULL;
+}
+
+/*
+ * Soft information is provided as a sidecar file of signed 8-bit LLRs,
+ * either one per symbol or one per bit of the capture. Since taggings
+ * permute whole symbols, the reliability of a symbol is that of its
+ * least reliable bit.
+ */
+BOOL
+symtag_load_reliabilities(symtag_t *self, const char *file)
+{
+  struct symtag_window window;
+  const int8_t *llr_data;
+  uint8_t *rel_data = NULL;
+  uint64_t llr_len, llr_per_sym;
+  uint64_t avail, i, j, sym;
+  unsigned int rel;
+  BOOL ok = FALSE;
+
+  struct stat sbuf;
+  int fd = -1;
+
+  symtag_window_init(&window, -1, 0);
+
+  if (stat(file, &sbuf) == -1) {
+    ERROR("Cannot stat `%s': %s\n", file, strerror(errno));
+    goto fail;
+  }
+
+  llr_len = sbuf.st_size;
+
+  if (self->tagging.bps > 1 && llr_len >= self->sym_len * self->tagging.bps) {
+    llr_per_sym = self->tagging.bps;
+  } else if (llr_len >= self->sym_len) {
+    llr_per_sym = 1;
+  } else {
+    ERROR(
+        "Soft information file `%s' is too short for this capture\n",
+        file);
+    goto fail;
+  }
+
+  llr_len = self->sym_len * llr_per_sym;
+
+  if ((fd = open(file, O_RDONLY)) == -1) {
+    ERROR("Cannot open `%s': %s\n", file, strerror(errno));
     goto fail;
-  } else if (valid < sym_len) {
-    page_size = getpagesize();
+  }
+
+  symtag_window_init(&window, fd, llr_len);
+  fd = -1;
+
+  ALLOCATE_MANY(rel_data, self->sym_len, uint8_t);
+  memset(rel_data, 0xff, self->sym_len);
 
-    chop_start = ((valid + page_size - 1) / page_size) * page_size;
+  for (i = 0; i < llr_len; i += avail) {
+    TRY(
+        llr_data = (const int8_t *) symtag_window_get(&window, i, &avail));
 
-    if (chop_start < sym_len)
-      munmap(sym_data + chop_start, sym_len - chop_start);
+    if (avail > llr_len - i)
+      avail = llr_len - i;
 
-    sym_len = valid;
+    for (j = 0; j < avail; ++j) {
+      sym = (i + j) / llr_per_sym;
+      rel = llr_data[j] < 0 ? -llr_data[j] : llr_data[j];
+
+      if (rel < rel_data[sym])
+        rel_data[sym] = rel;
+    }
+
+    symtag_window_release(&window, i + avail);
   }
 
-  self = symtag_new(sym_data, sym_len, bps, cb, private);
-  sym_data = (uint8_t *) -1;
+  if (self->rel_data != NULL)
+    free(self->rel_data);
 
-  TRY(self != NULL);
+  self->rel_data = rel_data;
+  rel_data = NULL;
 
-  return self;
+  ok = TRUE;
 
 fail:
-  if (sym_data != (uint8_t *) -1)
-    munmap(sym_data, sym_len);
+  symtag_window_finalize(&window);
 
-  if (self != NULL)
-    symtag_destroy(self);
+  if (fd != -1)
+    close(fd);
+
+  if (rel_data != NULL)
+    free(rel_data);
+
+  return ok;
+}
+
+void
+symtag_set_threads(symtag_t *self, unsigned int threads)
+{
+  self->threads = threads > 0 ? threads : 1;
+}
+
+void
+symtag_set_numa(symtag_t *self, BOOL numa)
+{
+  self->numa = numa;
+}
+
+void
+symtag_set_hugepages(symtag_t *self, BOOL hugepages)
+{
+  self->hugepages = hugepages;
+  self->window.huge = hugepages;
+}
+
+struct symtag_replica_job {
+  symtag_t *owner;
+  uint8_t *replica;
+  unsigned int node;
+  BOOL ok;
+};
+
+static BOOL
+symtag_copy_replica(symtag_t *self, uint8_t *replica)
+{
+  const uint8_t *sym_data;
+  uint64_t p, avail;
+
+  for (p = 0; p < self->sym_len; p += avail) {
+    TRY(sym_data = symtag_window_get(&self->window, p, &avail));
+
+    if (avail > self->sym_len - p)
+      avail = self->sym_len - p;
+
+    memcpy(replica + p, sym_data, avail);
+    symtag_window_release(&self->window, p + avail);
+  }
+
+  return TRUE;
+
+fail:
+  return FALSE;
+}
+
+static void *
+symtag_replica_thread(void *data)
+{
+  struct symtag_replica_job *job = (struct symtag_replica_job *) data;
+
+  (void) numanode_bind_thread(job->node);
+
+  job->ok = symtag_copy_replica(job->owner, job->replica);
 
   return NULL;
 }
 
+/*
+ * Copy the capture once per node. If the pages could not be bound with
+ * mbind, the copy is made from a thread running on the target node, so
+ * that first-touch places them there instead. Copies are sequential, as
+ * they all go through the owner's window.
+ */
 static BOOL
-symtag_tag_internal(symtag_t *self, unsigned int sym)
+symtag_make_replicas(symtag_t *self, unsigned int nodes)
 {
-  unsigned int i, j;
-  uint64_t bit;
-  uint8_t *bit_data;
+  struct symtag_replica_job job;
+  pthread_t thread;
+  BOOL bound;
+  unsigned int i;
 
-  /* Selecting bit */
-  if (sym < self->tagging.dict_len) {
-    for (i = 0; i < self->tagging.dict_len; ++i) {
-      bit = 1ull << i;
-      if ((self->sel_mask & bit) == 0) {
-        self->sel_mask |= bit;
-        self->tagging.dict[sym] = i;
+  for (i = 0; i < nodes; ++i) {
+    TRY(job.replica = numanode_alloc(self->sym_len, i, &bound));
+    self->replica_list[self->replica_count++] = job.replica;
 
-        if (!symtag_tag_internal(self, sym + 1))
-          goto fail;
+    job.owner = self;
+    job.node = i;
 
-        self->sel_mask &= ~bit;
-      }
-    }
-  } else {
-    bit_data = self->bit_data;
-    for (i = 0; i < self->sym_len; ++i) {
+    if (!bound
+        && pthread_create(&thread, NULL, symtag_replica_thread, &job) == 0)
+      pthread_join(thread, NULL);
+    else
+      job.ok = symtag_copy_replica(self, job.replica);
+
+    TRY(job.ok);
+  }
+
+  return TRUE;
+
+fail:
+  symtag_free_replicas(self);
+
+  return FALSE;
+}
+
+static void
+symtag_worker_finalize(struct symtag_worker *self)
+{
+  symtag_window_unmap(&self->window);
+
+  if (self->tagging.dict != NULL)
+    free(self->tagging.dict);
+
+  if (self->packed_data != NULL)
+    hugemem_free(self->packed_data);
+
+  self->tagging.dict = NULL;
+  self->packed_data = NULL;
+}
+
+static void
+symtag_worker_init(struct symtag_worker *self, symtag_t *owner, int node)
+{
+  memset(self, 0, sizeof(struct symtag_worker));
+
+  self->owner = owner;
+  self->node = node;
+  self->tagging = owner->tagging;
+  self->tagging.dict = NULL;
+
+  /* Workers share the file descriptor, but not the mapping */
+  symtag_window_init(
+      &self->window,
+      owner->window.fd,
+      owner->window.file_len);
+  self->window.buffer = owner->window.buffer;
+  self->window.huge = owner->hugepages;
+
+  if (node >= 0 && (unsigned int) node < owner->replica_count)
+    self->replica = owner->replica_list[node];
+}
+
+static const uint8_t *
+symtag_worker_get_symbols(
+    struct symtag_worker *self,
+    uint64_t off,
+    uint64_t *avail)
+{
+  if (self->replica != NULL) {
+    *avail = self->owner->sym_len - off;
+    return self->replica + off;
+  }
+
+  return symtag_window_get(&self->window, off, avail);
+}
+
+static BOOL
+symtag_worker_expand(struct symtag_worker *self)
+{
+  const uint8_t *sym_data;
+  uint64_t *packed_data = self->packed_data;
+  uint64_t sym_len = self->owner->sym_len;
+  uint64_t p, q;
+  uint64_t avail;
+  uint64_t acc = 0;
+  unsigned int acc_bits = 0;
+  unsigned int j;
+  uint8_t bit;
+
+  for (p = 0; p < sym_len; p += avail) {
+    TRY(sym_data = symtag_worker_get_symbols(self, p, &avail));
+
+    if (avail > sym_len - p)
+      avail = sym_len - p;
+
+    for (q = 0; q < avail; ++q) {
       j = self->tagging.bps;
-      do
-        *bit_data++ =
-            (self->tagging.dict[
-                 (self->sym_data[i] - '0') & self->tagging.mask] >> --j) & 1;
-      while (j != 0);
+      do {
+        bit = (self->tagging.dict[
+                 (sym_data[q] - '0') & self->tagging.mask] >> --j) & 1;
+
+        acc |= (uint64_t) bit << acc_bits;
+        if (++acc_bits == 64) {
+          *packed_data++ = acc;
+          acc = 0;
+          acc_bits = 0;
+        }
+      } while (j != 0);
     }
 
-    tagging_compute_properties(&self->tagging);
+    if (self->replica == NULL)
+      symtag_window_release(&self->window, p + avail);
+  }
 
-    /* All bits selected, call handler */
-    TRY((self->on_tagging) (
-        self->private,
-        &self->tagging,
-        self->bit_data,
-        self->bit_len));
+  /* Partial last word, then the zero padding word */
+  if (acc_bits != 0)
+    *packed_data++ = acc;
+  *packed_data = 0;
+
+  return TRUE;
+
+fail:
+  return FALSE;
+}
 
-    ++self->tagging.tagging_id;
+static BOOL
+symtag_worker_run(struct symtag_worker *self)
+{
+  symtag_t *owner = self->owner;
+  uint64_t id;
+
+  /* Bind before allocating, so that first-touch keeps buffers local */
+  if (self->node >= 0)
+    (void) numanode_bind_thread(self->node);
+
+  ALLOCATE_MANY(self->tagging.dict, self->tagging.dict_len, uint8_t);
+  TRY(self->packed_data = hugemem_alloc(
+      (owner->bit_len / 64 + 2) * sizeof(uint64_t),
+      owner->hugepages));
+
+  while (!atomic_load(&owner->failed)) {
+    id = __sync_fetch_and_add(&owner->next_tagging, 1);
+    if (id >= owner->tagging_count)
+      break;
+
+    tagging_set_id(&self->tagging, id);
+
+    TRY(symtag_worker_expand(self));
+
+    TRY((owner->on_tagging) (
+        owner->private,
+        &self->tagging,
+        self->packed_data,
+        owner->bit_len));
   }
 
   return TRUE;
 
 fail:
+  atomic_store(&owner->failed, TRUE);
+
   return FALSE;
 }
 
+static void *
+symtag_worker_thread(void *data)
+{
+  (void) symtag_worker_run((struct symtag_worker *) data);
+
+  return NULL;
+}
+
 BOOL
 symtag_tag(symtag_t *self)
 {
-  self->tagging.tagging_id = 0;
-  self->sel_mask = 0;
+  struct symtag_worker *worker_list = NULL;
+  unsigned int nodes = 1;
+  unsigned int i;
+  int err;
+  BOOL ok = FALSE;
+
+  self->next_tagging = 0;
+  self->tagging_count = symtag_get_tagging_count(self);
+  atomic_store(&self->failed, FALSE);
+
+  if (self->numa)
+    nodes = MIN(numanode_get_count(), self->threads);
 
-  return symtag_tag_internal(self, 0);
+  if (nodes > 1 && self->replica_count == 0)
+    TRY(symtag_make_replicas(self, nodes));
+
+  /* From now on, workers map the capture on their own */
+  symtag_window_unmap(&self->window);
+
+  ALLOCATE_MANY(worker_list, self->threads, struct symtag_worker);
+
+  for (i = 0; i < self->threads; ++i)
+    symtag_worker_init(
+        worker_list + i,
+        self,
+        nodes > 1 ? (int) (i % nodes) : -1);
+
+  if (self->threads == 1) {
+    (void) symtag_worker_run(worker_list);
+  } else {
+    for (i = 0; i < self->threads; ++i) {
+      if ((err = pthread_create(
+          &worker_list[i].thread,
+          NULL,
+          symtag_worker_thread,
+          worker_list + i)) != 0) {
+        ERROR("Failed to create tagging worker: %s\n", strerror(err));
+        atomic_store(&self->failed, TRUE);
+        break;
+      }
+
+      worker_list[i].have_thread = TRUE;
+    }
+
+    for (i = 0; i < self->threads; ++i)
+      if (worker_list[i].have_thread)
+        pthread_join(worker_list[i].thread, NULL);
+  }
+
+  ok = !atomic_load(&self->failed);
+
+fail:
+  if (worker_list != NULL) {
+    for (i = 0; i < self->threads; ++i)
+      symtag_worker_finalize(worker_list + i);
+
+    free(worker_list);
+  }
+
+  return ok;
 }
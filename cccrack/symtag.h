@@ -23,8 +23,12 @@
 #define _SYMTAG_H
 
 #include <stdint.h>
+#include <pthread.h>
+#include <stdatomic.h>
 #include <defs.h>
 
+#include "numanode.h"
+
 struct tagging {
   uint8_t *dict;
   size_t dict_len;
@@ -49,21 +53,113 @@ void tagging_debug(const struct tagging *tagging);
 
 void tagging_finalize(struct tagging *self);
 BOOL tagging_copy(struct tagging *dest, const struct tagging *orig);
+BOOL tagging_init(struct tagging *self, unsigned int bps, uint64_t id);
+void tagging_set_id(struct tagging *self, uint64_t id);
+
+/* dict_len!, saturated */
+static inline uint64_t
+tagging_get_count(const struct tagging *self)
+{
+  uint64_t result = 1;
+  uint64_t val = self->dict_len;
+
+  while (val > 1) {
+    if (result > UINT64_MAX / val)
+      return UINT64_MAX;
+    result *= val--;
+  }
+
+  return result;
+}
+
+/*
+ * Captures are accessed through a sliding mmap window. Captures smaller
+ * than SYMTAG_WINDOW_SIZE are mapped at once and stay resident during the
+ * whole tagging process.
+ */
+#define SYMTAG_WINDOW_SIZE  (64ull << 20)
+
+struct symtag_window {
+  const uint8_t *buffer; /* In-memory capture, not owned. No fd if set */
+  int fd;
+  uint64_t file_len;   /* Size of the underlying file */
+  uint8_t *base;       /* Current mapping */
+  uint64_t offset;     /* File offset of the current mapping */
+  size_t   size;       /* Size of the current mapping */
+  uint64_t released;   /* File offset up to which pages were released */
+  BOOL huge;           /* Pre-fault mappings and ask for huge pages */
+};
+
+/* Called when the tagger no longer needs a caller-owned capture buffer */
+typedef void (*symtag_release_cb_t) (
+    void *private,
+    const uint8_t *data,
+    uint64_t len);
+
+/* 64 bits starting at bit pos of a packed buffer */
+static inline uint64_t
+symtag_packed_get_word(const uint64_t *packed, uint64_t pos)
+{
+  uint64_t i = pos >> 6;
+  unsigned int shift = pos & 63;
+
+  if (shift == 0)
+    return packed[i];
+
+  return (packed[i] >> shift) | (packed[i + 1] << (64 - shift));
+}
 
+/*
+ * packed holds len bits, 64 per word (bit i is bit i & 63 of word
+ * i >> 6), followed by a zero word.
+ */
 typedef BOOL (*symtag_tagging_cb_t) (
     void *private,
     const struct tagging *tagging,
-    const uint8_t *bits,
+    const uint64_t *packed,
     size_t len);
 
+struct symtag;
+
+/*
+ * Taggings are distributed among workers, each one with its own tagging
+ * dictionary, packed bit buffer and view of the capture. In NUMA mode,
+ * workers are bound to a node and read from a replica of the capture
+ * living in that node.
+ */
+struct symtag_worker {
+  struct symtag *owner;
+  pthread_t thread;
+  BOOL have_thread;
+  int node; /* -1 if not bound */
+
+  struct tagging tagging;
+  struct symtag_window window;
+  const uint8_t *replica;
+  uint64_t *packed_data;
+};
+
 struct symtag {
-  uint8_t *sym_data;
-  uint8_t *bit_data;
+  struct symtag_window window;
+  uint8_t *rel_data; /* Per-symbol reliabilities (|LLR|), may be NULL */
   struct tagging tagging;
-  size_t sym_len;
-  size_t bit_len;
+  uint64_t sym_len;
+  uint64_t bit_len;
+
+  unsigned int threads;
+  BOOL numa;
+  BOOL hugepages;
+  uint8_t *replica_list[NUMANODE_MAX_NODES];
+  unsigned int replica_count;
+
+  uint64_t next_tagging;
+  uint64_t tagging_count;
+  atomic_int failed; /* Set by any worker, polled by all */
 
-  uint64_t sel_mask;
+  const uint8_t *buffer;
+  uint64_t buffer_len;
+  symtag_release_cb_t release;
+  void *release_private;
 
   void *private;
   symtag_tagging_cb_t on_tagging;
@@ -74,13 +170,13 @@ typedef struct symtag symtag_t;
 static inline uint64_t
 symtag_get_tagging_count(const symtag_t *self)
 {
-  uint64_t result = 1;
-  uint64_t val = self->tagging.dict_len;
-
-  while (val > 1)
-    result *= val--;
+  return tagging_get_count(&self->tagging);
+}
 
-  return result;
+static inline const uint8_t *
+symtag_get_reliabilities(const symtag_t *self)
+{
+  return self->rel_data;
 }
 
 void symtag_destroy(symtag_t *self);
@@ -91,6 +187,21 @@ symtag_t *symtag_new_from_file(
     symtag_tagging_cb_t cb,
     void *private);
 
+symtag_t *symtag_new_from_buffer(
+    const uint8_t *data,
+    uint64_t len,
+    symtag_release_cb_t release,
+    void *release_private,
+    unsigned int bps,
+    symtag_tagging_cb_t cb,
+    void *private);
+
+BOOL symtag_load_reliabilities(symtag_t *self, const char *file);
+
+void symtag_set_threads(symtag_t *self, unsigned int threads);
+void symtag_set_numa(symtag_t *self, BOOL numa);
+void symtag_set_hugepages(symtag_t *self, BOOL hugepages);
+
 BOOL symtag_tag(symtag_t *self);
 
 #endif /* _SYMTAG_H */
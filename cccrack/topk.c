@@ -0,0 +1,145 @@
+/*
+  topk.c: Streaming top-k index
+
+  Copyright (C) 2019 Gonzalo José Carracedo Carballal
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this program.  If not, see
+  <http://www.gnu.org/licenses/>
+
+*/
+
+#include <string.h>
+
+#include "topk.h"
+
+void
+topk_destroy(topk_t *self)
+{
+  if (self->heap != NULL)
+    free(self->heap);
+
+  free(self);
+}
+
+topk_t *
+topk_new(unsigned int k)
+{
+  topk_t *self = NULL;
+
+  ALLOCATE(self, topk_t);
+  ALLOCATE_MANY(self->heap, k, struct topk_entry);
+
+  self->k = k;
+
+  return self;
+
+fail:
+  if (self != NULL)
+    topk_destroy(self);
+
+  return NULL;
+}
+
+void
+topk_reset(topk_t *self)
+{
+  self->size = 0;
+}
+
+/* TRUE if a is a worse entry than b */
+static inline BOOL
+topk_entry_less(const struct topk_entry *a, const struct topk_entry *b)
+{
+  if (a->key != b->key)
+    return a->key < b->key;
+
+  return a->index > b->index;
+}
+
+static void
+topk_sift_down(topk_t *self, unsigned int i)
+{
+  struct topk_entry tmp;
+  unsigned int child;
+
+  while ((child = 2 * i + 1) < self->size) {
+    if (child + 1 < self->size
+        && topk_entry_less(self->heap + child + 1, self->heap + child))
+      ++child;
+
+    if (!topk_entry_less(self->heap + child, self->heap + i))
+      break;
+
+    tmp = self->heap[i];
+    self->heap[i] = self->heap[child];
+    self->heap[child] = tmp;
+
+    i = child;
+  }
+}
+
+static void
+topk_sift_up(topk_t *self, unsigned int i)
+{
+  struct topk_entry tmp;
+  unsigned int parent;
+
+  while (i > 0) {
+    parent = (i - 1) / 2;
+
+    if (!topk_entry_less(self->heap + i, self->heap + parent))
+      break;
+
+    tmp = self->heap[i];
+    self->heap[i] = self->heap[parent];
+    self->heap[parent] = tmp;
+
+    i = parent;
+  }
+}
+
+void
+topk_push(topk_t *self, uint64_t key, uint64_t index)
+{
+  struct topk_entry entry = {key, index};
+
+  if (self->size < self->k) {
+    self->heap[self->size++] = entry;
+    topk_sift_up(self, self->size - 1);
+  } else if (self->k > 0 && topk_entry_less(self->heap, &entry)) {
+    /* Better than the worst retained entry: replace it */
+    self->heap[0] = entry;
+    topk_sift_down(self, 0);
+  }
+}
+
+static int
+topk_entry_index_cmp(const void *a, const void *b)
+{
+  const struct topk_entry *ea = (const struct topk_entry *) a;
+  const struct topk_entry *eb = (const struct topk_entry *) b;
+
+  return (ea->index > eb->index) - (ea->index < eb->index);
+}
+
+/* Destroys the heap property. Call topk_reset before pushing again. */
+void
+topk_sort_by_index(topk_t *self)
+{
+  qsort(
+      self->heap,
+      self->size,
+      sizeof(struct topk_entry),
+      topk_entry_index_cmp);
+}
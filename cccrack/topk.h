@@ -0,0 +1,64 @@
+/*
+  topk.h: Streaming top-k index
+
+  Copyright (C) 2019 Gonzalo José Carracedo Carballal
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this program.  If not, see
+  <http://www.gnu.org/licenses/>
+
+*/
+
+#ifndef _TOPK_H
+#define _TOPK_H
+
+#include <stdint.h>
+#include <defs.h>
+
+/*
+ * Keeps the k entries with the largest keys out of an arbitrarily long
+ * stream of (key, index) pairs, using a binary min-heap of size k. Ties
+ * are broken in favour of the lowest index.
+ */
+struct topk_entry {
+  uint64_t key;
+  uint64_t index;
+};
+
+struct topk {
+  struct topk_entry *heap;
+  unsigned int size;
+  unsigned int k;
+};
+
+typedef struct topk topk_t;
+
+static inline unsigned int
+topk_get_size(const topk_t *self)
+{
+  return self->size;
+}
+
+void topk_destroy(topk_t *self);
+topk_t *topk_new(unsigned int k);
+void topk_reset(topk_t *self);
+void topk_push(topk_t *self, uint64_t key, uint64_t index);
+void topk_sort_by_index(topk_t *self);
+
+static inline uint64_t
+topk_get_index(const topk_t *self, unsigned int i)
+{
+  return self->heap[i].index;
+}
+
+#endif /* _TOPK_H */
@@ -0,0 +1,316 @@
+/*
+  viterbi.c: Hard-decision Viterbi decoder for rate 1/n codes
+
+  Copyright (C) 2019 Gonzalo José Carracedo Carballal
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this program.  If not, see
+  <http://www.gnu.org/licenses/>
+
+*/
+
+#include <string.h>
+#include <stdlib.h>
+
+#include "viterbi.h"
+#include "symtag.h"
+#include "hugemem.h"
+
+/*
+ * Add-compare-select runs on GCC vectors of 8 metrics. They map to
+ * SSE2 registers on x86-64 (and to wider ones when built with AVX)
+ * and to generic code elsewhere.
+ */
+#define VITERBI_LANES 8
+
+typedef uint16_t viterbi_vec_t
+    __attribute__((vector_size(2 * VITERBI_LANES), aligned(2)));
+typedef int16_t viterbi_mask_t
+    __attribute__((vector_size(2 * VITERBI_LANES), aligned(2)));
+
+#ifdef __clang__
+#  define VITERBI_INTERLEAVE_LO(a, b) \
+  __builtin_shufflevector(a, b, 0, 8, 1, 9, 2, 10, 3, 11)
+#  define VITERBI_INTERLEAVE_HI(a, b) \
+  __builtin_shufflevector(a, b, 4, 12, 5, 13, 6, 14, 7, 15)
+#else
+#  define VITERBI_INTERLEAVE_LO(a, b) \
+  __builtin_shuffle(a, b, (viterbi_mask_t) {0, 8, 1, 9, 2, 10, 3, 11})
+#  define VITERBI_INTERLEAVE_HI(a, b) \
+  __builtin_shuffle(a, b, (viterbi_mask_t) {4, 12, 5, 13, 6, 14, 7, 15})
+#endif /* __clang__ */
+
+/* Metrics grow at most n per step. Renormalize well before overflow */
+#define VITERBI_RENORM_INTERVAL 64
+
+/*
+ * The branch metric table has 2^(n + K) entries, and metrics must not
+ * overflow between renormalizations.
+ */
+BOOL
+viterbi_is_supported(unsigned int n, unsigned int K)
+{
+  return n > 0 && n <= VITERBI_MAX_N
+      && K > 1 && K <= VITERBI_MAX_K
+      && ((uint64_t) 1 << (n + K)) <= VITERBI_MAX_TABLE_SIZE
+      && n * VITERBI_RENORM_INTERVAL < 0x8000;
+}
+
+void
+viterbi_destroy(viterbi_t *self)
+{
+  if (self->bm_table != NULL)
+    hugemem_free(self->bm_table);
+
+  if (self->metric != NULL)
+    free(self->metric);
+
+  if (self->next != NULL)
+    free(self->next);
+
+  if (self->decisions != NULL)
+    hugemem_free(self->decisions);
+
+  if (self->tb_bits != NULL)
+    free(self->tb_bits);
+
+  free(self);
+}
+
+/* If huge, the big tables are backed by huge pages */
+viterbi_t *
+viterbi_new(
+    unsigned int n,
+    unsigned int K,
+    const uint64_t *taps,
+    BOOL huge)
+{
+  viterbi_t *self = NULL;
+  unsigned int half, y, u, b, i, j;
+  uint64_t r, out;
+  uint16_t *bm;
+
+  TRY(viterbi_is_supported(n, K));
+
+  ALLOCATE(self, viterbi_t);
+
+  self->n      = n;
+  self->K      = K;
+  self->states = 1 << (K - 1);
+  self->depth  = 5 * K;
+  self->ring   = self->depth + VITERBI_TRACEBACK_CHUNK;
+
+  half = self->states / 2;
+
+  TRY(self->bm_table = hugemem_alloc(
+      ((size_t) 1 << (n + K)) * sizeof(uint16_t),
+      huge));
+  ALLOCATE_MANY(self->metric, self->states, uint16_t);
+  ALLOCATE_MANY(self->next, self->states, uint16_t);
+  TRY(self->decisions = hugemem_alloc(
+      (size_t) self->ring * self->states * sizeof(uint16_t),
+      huge));
+  ALLOCATE_MANY(self->tb_bits, self->ring, uint8_t);
+
+  /* Register r = (predecessor << 1) | u, predecessor = i + b * S / 2 */
+  for (y = 0; y < (1u << n); ++y)
+    for (b = 0; b < 2; ++b)
+      for (u = 0; u < 2; ++u) {
+        bm = self->bm_table
+            + ((size_t) y << K)
+            + (u + 2 * b) * half;
+
+        for (i = 0; i < half; ++i) {
+          r = ((uint64_t) i << 1) | u | ((uint64_t) b << (K - 1));
+
+          out = 0;
+          for (j = 0; j < n; ++j)
+            out |= (uint64_t) __builtin_parityll(r & taps[j]) << j;
+
+          bm[i] = __builtin_popcountll(out ^ y);
+        }
+      }
+
+  return self;
+
+fail:
+  if (self != NULL)
+    viterbi_destroy(self);
+
+  return NULL;
+}
+
+static void
+viterbi_acs_vector(
+    viterbi_t *self,
+    const uint16_t *bm,
+    uint16_t *decisions)
+{
+  unsigned int half = self->states / 2;
+  unsigned int i;
+  viterbi_vec_t m0, m1, a, b, new0, new1;
+  viterbi_mask_t d0, d1;
+
+  for (i = 0; i < half; i += VITERBI_LANES) {
+    m0 = *(const viterbi_vec_t *) (self->metric + i);
+    m1 = *(const viterbi_vec_t *) (self->metric + i + half);
+
+    /* Next state 2i */
+    a  = m0 + *(const viterbi_vec_t *) (bm + i);
+    b  = m1 + *(const viterbi_vec_t *) (bm + 2 * half + i);
+    d0 = b < a;
+    new0 = a ^ ((a ^ b) & (viterbi_vec_t) d0);
+
+    /* Next state 2i + 1 */
+    a  = m0 + *(const viterbi_vec_t *) (bm + half + i);
+    b  = m1 + *(const viterbi_vec_t *) (bm + 3 * half + i);
+    d1 = b < a;
+    new1 = a ^ ((a ^ b) & (viterbi_vec_t) d1);
+
+    *(viterbi_vec_t *) (self->next + 2 * i) =
+        VITERBI_INTERLEAVE_LO(new0, new1);
+    *(viterbi_vec_t *) (self->next + 2 * i + VITERBI_LANES) =
+        VITERBI_INTERLEAVE_HI(new0, new1);
+
+    *(viterbi_mask_t *) (decisions + 2 * i) =
+        VITERBI_INTERLEAVE_LO(d0, d1);
+    *(viterbi_mask_t *) (decisions + 2 * i + VITERBI_LANES) =
+        VITERBI_INTERLEAVE_HI(d0, d1);
+  }
+}
+
+/* For codes with fewer than 2 * VITERBI_LANES states */
+static void
+viterbi_acs_scalar(
+    viterbi_t *self,
+    const uint16_t *bm,
+    uint16_t *decisions)
+{
+  unsigned int half = self->states / 2;
+  unsigned int i, u;
+  uint16_t a, b;
+
+  for (i = 0; i < half; ++i)
+    for (u = 0; u < 2; ++u) {
+      a = self->metric[i] + bm[u * half + i];
+      b = self->metric[i + half] + bm[(u + 2) * half + i];
+
+      self->next[2 * i + u] = b < a ? b : a;
+      decisions[2 * i + u] = b < a;
+    }
+}
+
+static unsigned int
+viterbi_best_state(const viterbi_t *self)
+{
+  unsigned int i, best = 0;
+
+  for (i = 1; i < self->states; ++i)
+    if (self->metric[i] < self->metric[best])
+      best = i;
+
+  return best;
+}
+
+/* Trace back from the best state at step last, down to step first */
+static void
+viterbi_traceback(viterbi_t *self, uint64_t first, uint64_t last)
+{
+  unsigned int s = viterbi_best_state(self);
+  unsigned int half = self->states / 2;
+  uint64_t t = last + 1;
+  const uint16_t *decisions;
+
+  while (t-- > first) {
+    decisions = self->decisions + (t % self->ring) * self->states;
+    self->tb_bits[t - first] = s & 1;
+    s = (s >> 1) | (decisions[s] != 0 ? half : 0);
+  }
+}
+
+BOOL
+viterbi_decode(
+    viterbi_t *self,
+    const uint64_t *packed,
+    uint64_t len,
+    unsigned int phase,
+    uint8_t *out,
+    uint64_t *steps,
+    uint64_t *errors)
+{
+  unsigned int n = self->n;
+  unsigned int i;
+  uint64_t count, t, emitted = 0;
+  uint64_t norm = 0;
+  uint64_t mask = (1ull << n) - 1;
+  uint64_t y;
+  uint16_t min;
+  uint16_t *tmp;
+
+  *steps  = 0;
+  *errors = 0;
+
+  if (len < phase + n)
+    return TRUE;
+
+  count = (len - phase) / n;
+
+  /* The starting state is unknown */
+  memset(self->metric, 0, self->states * sizeof(uint16_t));
+
+  for (t = 0; t < count; ++t) {
+    y = symtag_packed_get_word(packed, phase + t * n) & mask;
+
+    if (self->states >= 2 * VITERBI_LANES)
+      viterbi_acs_vector(
+          self,
+          self->bm_table + (y << self->K),
+          self->decisions + (t % self->ring) * self->states);
+    else
+      viterbi_acs_scalar(
+          self,
+          self->bm_table + (y << self->K),
+          self->decisions + (t % self->ring) * self->states);
+
+    tmp = self->metric;
+    self->metric = self->next;
+    self->next = tmp;
+
+    if ((t + 1) % VITERBI_RENORM_INTERVAL == 0) {
+      min = self->metric[viterbi_best_state(self)];
+      for (i = 0; i < self->states; ++i)
+        self->metric[i] -= min;
+      norm += min;
+    }
+
+    /* Ring is full: the oldest chunk has converged */
+    if (t + 1 - emitted == self->ring) {
+      if (out != NULL) {
+        viterbi_traceback(self, emitted, t);
+        memcpy(out + emitted, self->tb_bits, VITERBI_TRACEBACK_CHUNK);
+      }
+
+      emitted += VITERBI_TRACEBACK_CHUNK;
+    }
+  }
+
+  if (out != NULL && emitted < count) {
+    viterbi_traceback(self, emitted, count - 1);
+    memcpy(out + emitted, self->tb_bits, count - emitted);
+  }
+
+  *steps  = count;
+  *errors = norm + self->metric[viterbi_best_state(self)];
+
+  return TRUE;
+}
@@ -0,0 +1,85 @@
+/*
+  viterbi.h: Hard-decision Viterbi decoder for rate 1/n codes
+
+  Copyright (C) 2019 Gonzalo José Carracedo Carballal
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this program.  If not, see
+  <http://www.gnu.org/licenses/>
+
+*/
+
+#ifndef _VITERBI_H
+#define _VITERBI_H
+
+#include <stdint.h>
+#include <defs.h>
+
+#define VITERBI_MAX_N            16
+#define VITERBI_MAX_K            16
+#define VITERBI_MAX_TABLE_SIZE   (1 << 22) /* Branch metric entries */
+#define VITERBI_TRACEBACK_CHUNK  64
+
+/*
+ * Decoder for rate 1/n codes with constraint length K. taps[j] describes
+ * output j: bit m is the tap on the input bit entered m steps before.
+ *
+ * The encoder state is the last K - 1 inputs (bit m - 1 is the input
+ * entered m steps before). Next states 2i and 2i + 1 share the
+ * predecessors i and i + S / 2, so add-compare-select runs on vectors
+ * of consecutive i, and branch metrics for every received word are
+ * precomputed in the same order.
+ */
+struct viterbi {
+  unsigned int n;
+  unsigned int K;
+  unsigned int states;
+  unsigned int depth;   /* Traceback depth */
+  unsigned int ring;    /* Steps kept in the decision ring */
+
+  uint16_t *bm_table;   /* [received][u + 2 * b][i] */
+  uint16_t *metric;
+  uint16_t *next;
+  uint16_t *decisions;  /* ring x states, non-zero if b = 1 won */
+  uint8_t *tb_bits;
+};
+
+typedef struct viterbi viterbi_t;
+
+/* Whether viterbi_new() can build a decoder for these parameters */
+BOOL viterbi_is_supported(unsigned int n, unsigned int K);
+
+void viterbi_destroy(viterbi_t *self);
+viterbi_t *viterbi_new(
+    unsigned int n,
+    unsigned int K,
+    const uint64_t *taps,
+    BOOL huge);
+
+/*
+ * Decode the packed stream (len bits, followed by a zero word) starting
+ * at bit phase. If out is not NULL, it receives one decoded bit per byte
+ * and must have room for (len - phase) / n bytes. errors receives the
+ * metric of the best path, i.e. the number of coded bits that had to be
+ * corrected.
+ */
+BOOL viterbi_decode(
+    viterbi_t *self,
+    const uint64_t *packed,
+    uint64_t len,
+    unsigned int phase,
+    uint8_t *out,
+    uint64_t *steps,
+    uint64_t *errors);
+
+#endif /* _VITERBI_H */
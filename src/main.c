@@ -8,7 +8,9 @@
 #include <string.h>
 #include <errno.h>
 #include <getopt.h>
+#include <inttypes.h>
 
+#include <defs.h>
 #include <cccrack.h>
 
 static void
@@ -30,7 +32,7 @@ help(const char *progname)
       "  -t, --tagging=ID   Compute only symbol tagging number ID\n");
   fprintf(
       stderr,
-      "  -d, --dump=FILE    Dump retagged input to FILE (use with -t)\n");
+      "  -d, --dump=FILE    Dump retagged input to FILE (requires -t)\n");
   fprintf(
       stderr,
       "  -p, --params=k,n,K Force the parameters of the encoder to be k, n, K\n");
@@ -40,23 +42,125 @@ help(const char *progname)
   fprintf(
       stderr,
       "  -a, --all          Show all candidates, even the unlikely ones\n");
+  fprintf(
+      stderr,
+      "  -s, --soft=FILE    Read per-symbol or per-bit int8 LLRs from FILE and\n"
+      "                     build windows from the most reliable rows\n");
+  fprintf(
+      stderr,
+      "  -m, --soft-metric=min|sum\n"
+      "                     Rank rows by their minimum or summed |LLR|\n");
+  fprintf(
+      stderr,
+      "  -H, --hugepages    Back large buffers with pre-faulted huge pages\n");
+  fprintf(
+      stderr,
+      "  -j, --threads=NUM  Evaluate taggings using NUM threads\n");
+  fprintf(
+      stderr,
+      "  -N, --numa         Replicate the capture in every NUMA node and bind\n"
+      "                     threads to nodes (use with -j)\n");
+  fprintf(
+      stderr,
+      "  -V, --verify[=FRACTION]\n"
+      "                     Check the parity equations of each candidate\n"
+      "                     against the whole capture (or the given fraction)\n");
+  fprintf(
+      stderr,
+      "  -R, --max-violations=RATE\n"
+      "                     Highest rate of failed checks of a likely\n"
+      "                     candidate (default %g)\n",
+      CCCRACK_VERIFY_DEFAULT_MAX_RATE);
+  fprintf(
+      stderr,
+      "  -D, --decode[=PREFIX]\n"
+      "                     Viterbi-decode rate 1/n candidates and report\n"
+      "                     their BER. Decoded bits are saved to files\n"
+      "                     starting by PREFIX, if given\n");
+  fprintf(
+      stderr,
+      "  -r, --regions=N    Analyze N disjoint regions of the capture and\n"
+      "                     keep the result most of them agree on\n");
+  fprintf(
+      stderr,
+      "  -e, --estimate-n   Estimate n from the spectrum of the capture and\n"
+      "                     try only the window widths it allows\n");
+  fprintf(
+      stderr,
+      "  -w, --max-width=N  Try windows up to N bits wide (default %d)\n"
+      "  -L, --max-height=N Make windows up to N times as tall as the widest\n"
+      "                     one (default %d)\n"
+      "  -A, --adaptive     Grow windows only until their rank settles\n"
+      "  -T, --time-budget=SECS\n"
+      "                     Give up the analysis after SECS seconds\n"
+      "  -M, --memory-budget=MIB\n"
+      "                     Limit the memory taken by windows to MIB MiB\n",
+      CCCRACK_MAX_WIDTH,
+      CCCRACK_MAX_REL_HEIGHT);
+  fprintf(
+      stderr,
+      "  -x, --sample[=SEED]\n"
+      "                     Take window rows from random positions of the\n"
+      "                     whole capture, instead of its beginning\n");
+  fprintf(
+      stderr,
+      "  -u, --unique       Show each code once, listing the taggings that\n"
+      "                     produced it\n");
+  fprintf(
+      stderr,
+      "  -S, --stream       Analyze the file (or stdin, if `-') as a stream,\n"
+      "                     reporting code changes as they happen. Requires\n"
+      "                     -b.\n");
   fprintf(
       stderr,
       "  -h, --help         This help\n");
   putchar(10);
 }
 
+static int
+on_candidate(void *private, const cccrack_rankdef_t *candidate)
+{
+  unsigned int *count = (unsigned int *) private;
+
+  cccrack_rankdef_debug(candidate);
+  fflush(stdout);
+
+  ++*count;
+
+  return TRUE;
+}
+
+static void
+print_unique(const cccrack_t *cccrack)
+{
+  const unsigned int *taggings;
+  unsigned int i, j, count;
+
+  for (i = 0; i < cccrack_get_unique_count(cccrack); ++i) {
+    taggings = cccrack_get_unique_taggings(cccrack, i, &count);
+
+    printf("Candidate %d found by %d tagging(s):", i + 1, count);
+    for (j = 0; j < count; ++j)
+      printf(" %d", taggings[j]);
+    putchar(10);
+  }
+}
+
 static BOOL
 work(
     const char *progname,
     const char *file,
     const struct cccrack_params *params)
 {
-  unsigned int i, count;
+  struct cccrack_params cparams = *params;
+  unsigned int count = 0;
   cccrack_t *cccrack = NULL;
   BOOL ok = FALSE;
 
-  CONSTRUCT(cccrack, cccrack, file, params);
+  cparams.on_candidate = on_candidate;
+  cparams.private = &count;
+
+  CONSTRUCT(cccrack, cccrack, file, &cparams);
 
   if (params->tagging == -1)
     fprintf(
@@ -68,16 +172,20 @@ work(
 
   TRY(cccrack_run(cccrack));
 
-  count = cccrack_get_candidate_count(cccrack);
+  if (cccrack_is_incomplete(cccrack))
+    fprintf(
+        stderr,
+        "%s: time budget exhausted, some taggings were not analyzed\n",
+        progname);
 
   if (count == 0) {
     fprintf(stderr, "%s: no candidates found!\n", progname);
     exit(EXIT_FAILURE);
-  } else {
-    for (i = 0; i < count; ++i)
-      cccrack_rankdef_debug(cccrack_get_candidate(cccrack, i));
   }
 
+  if (params->unique)
+    print_unique(cccrack);
+
   ok = TRUE;
 
 fail:
@@ -87,6 +195,85 @@ fail:
   return ok;
 }
 
+static int
+on_stream_event(
+    void *private,
+    enum cccrack_stream_event event,
+    uint64_t bit_pos,
+    const cccrack_rankdef_t *candidate)
+{
+  const char *progname = (const char *) private;
+
+  switch (event) {
+    case CCCRACK_STREAM_EVENT_FOUND:
+      fprintf(
+          stderr,
+          "%s: candidate found at bit %llu\n",
+          progname,
+          (unsigned long long) bit_pos);
+      cccrack_rankdef_debug(candidate);
+      break;
+
+    case CCCRACK_STREAM_EVENT_LOST:
+      fprintf(
+          stderr,
+          "%s: code lost at bit %llu\n",
+          progname,
+          (unsigned long long) bit_pos);
+      break;
+  }
+
+  return TRUE;
+}
+
+static BOOL
+work_stream(
+    const char *progname,
+    const char *file,
+    const struct cccrack_params *params)
+{
+  struct cccrack_params sparams = *params;
+  cccrack_stream_t *stream = NULL;
+  FILE *fp = NULL;
+  uint8_t buffer[4096];
+  size_t got;
+  BOOL ok = FALSE;
+
+  if (sparams.tagging == -1)
+    sparams.tagging = 0;
+
+  if (strcmp(file, "-") == 0) {
+    fp = stdin;
+  } else if ((fp = fopen(file, "rb")) == NULL) {
+    fprintf(
+        stderr,
+        "%s: cannot open `%s': %s\n",
+        progname,
+        file,
+        strerror(errno));
+    goto fail;
+  }
+
+  TRY(stream = cccrack_stream_new(
+      &sparams,
+      on_stream_event,
+      (void *) progname));
+
+  while ((got = fread(buffer, 1, sizeof(buffer), fp)) > 0)
+    TRY(cccrack_stream_push_symbols(stream, buffer, got));
+
+  ok = TRUE;
+
+fail:
+  if (stream != NULL)
+    cccrack_stream_destroy(stream);
+
+  if (fp != NULL && fp != stdin)
+    fclose(fp);
+
+  return ok;
+}
+
 static struct option long_options[] = {
     {"bps",     required_argument, 0, 'b'},
     {"tagging", required_argument, 0, 't'},
@@ -94,6 +281,24 @@ static struct option long_options[] = {
     {"params",  required_argument, 0, 'p'},
     {"no-gray", no_argument,       0, 'n'},
     {"all",     no_argument,       0, 'a'},
+    {"soft",    required_argument, 0, 's'},
+    {"soft-metric", required_argument, 0, 'm'},
+    {"hugepages", no_argument,     0, 'H'},
+    {"threads", required_argument, 0, 'j'},
+    {"numa",    no_argument,       0, 'N'},
+    {"verify",  optional_argument, 0, 'V'},
+    {"max-violations", required_argument, 0, 'R'},
+    {"decode",  optional_argument, 0, 'D'},
+    {"regions", required_argument, 0, 'r'},
+    {"estimate-n", no_argument,    0, 'e'},
+    {"max-width", required_argument, 0, 'w'},
+    {"max-height", required_argument, 0, 'L'},
+    {"adaptive", no_argument,      0, 'A'},
+    {"time-budget", required_argument, 0, 'T'},
+    {"memory-budget", required_argument, 0, 'M'},
+    {"sample",  optional_argument, 0, 'x'},
+    {"unique",  no_argument,       0, 'u'},
+    {"stream",  no_argument,       0, 'S'},
     {"help",    no_argument,       0, 'h'},
     {0,         0,                 0,  0 }
 };
@@ -103,6 +308,10 @@ main(int argc, char *argv[], char *envp[])
 {
   struct cccrack_params params = cccrack_params_INITIALIZER;
   char *pathdup = NULL;
+  char *softdup = NULL;
+  char *decodedup = NULL;
+  unsigned int mib;
+  BOOL stream = FALSE;
   int c;
   int digit_optind = 0;
   int this_option_optind;
@@ -117,7 +326,7 @@ main(int argc, char *argv[], char *envp[])
     c = getopt_long(
         argc,
         argv,
-        "b:t:d:p:nah",
+        "b:t:d:p:nas:m:Hj:NV::R:D::r:ew:L:AT:M:x::uSh",
         long_options,
         &option_index);
 
@@ -126,7 +335,7 @@ main(int argc, char *argv[], char *envp[])
 
     switch (c) {
       case 'b':
-        if (sscanf(optarg, "%u", params.bps) < 1) {
+        if (sscanf(optarg, "%u", &params.bps) < 1) {
           fprintf(stderr, "%s: invalid bps value\n", argv[0]);
           goto fail;
         }
@@ -168,7 +377,9 @@ main(int argc, char *argv[], char *envp[])
           goto fail;
         }
 
-        if (params.K == 0) {
+        if (params.K == 0
+            || params.K > CCCRACK_MAX_CONSTRAINT
+            || params.k * (params.K - 1) >= CCCRACK_MAX_CONSTRAINT) {
           fprintf(stderr, "%s: invalid constraint length\n", argv[0]);
           goto fail;
         }
@@ -178,6 +389,130 @@ main(int argc, char *argv[], char *envp[])
         params.all = TRUE;
         break;
 
+      case 'H':
+        params.hugepages = TRUE;
+        break;
+
+      case 'j':
+        if (sscanf(optarg, "%u", &params.threads) < 1
+            || params.threads == 0) {
+          fprintf(stderr, "%s: invalid number of threads\n", argv[0]);
+          goto fail;
+        }
+        break;
+
+      case 'N':
+        params.numa = TRUE;
+        break;
+
+      case 'V':
+        params.verify = 1;
+        if (optarg != NULL
+            && (sscanf(optarg, "%f", &params.verify) < 1
+                || params.verify <= 0
+                || params.verify > 1)) {
+          fprintf(stderr, "%s: invalid verification fraction\n", argv[0]);
+          goto fail;
+        }
+        break;
+
+      case 'R':
+        if (sscanf(optarg, "%f", &params.verify_max_rate) < 1
+            || params.verify_max_rate < 0) {
+          fprintf(stderr, "%s: invalid violation rate\n", argv[0]);
+          goto fail;
+        }
+        break;
+
+      case 'D':
+        params.decode = TRUE;
+        if (optarg != NULL) {
+          TRY(decodedup = strdup(optarg));
+          params.decodefile = decodedup;
+        }
+        break;
+
+      case 'r':
+        if (sscanf(optarg, "%u", &params.regions) < 1
+            || params.regions == 0) {
+          fprintf(stderr, "%s: invalid number of regions\n", argv[0]);
+          goto fail;
+        }
+        break;
+
+      case 'e':
+        params.estimate_n = TRUE;
+        break;
+
+      case 'w':
+        if (sscanf(optarg, "%u", &params.max_width) < 1
+            || params.max_width < 3) {
+          fprintf(stderr, "%s: invalid maximum width\n", argv[0]);
+          goto fail;
+        }
+        break;
+
+      case 'L':
+        if (sscanf(optarg, "%u", &params.max_rel_height) < 1
+            || params.max_rel_height == 0) {
+          fprintf(stderr, "%s: invalid maximum height\n", argv[0]);
+          goto fail;
+        }
+        break;
+
+      case 'A':
+        params.adaptive = TRUE;
+        break;
+
+      case 'T':
+        if (sscanf(optarg, "%f", &params.time_budget) < 1
+            || params.time_budget <= 0) {
+          fprintf(stderr, "%s: invalid time budget\n", argv[0]);
+          goto fail;
+        }
+        break;
+
+      case 'M':
+        if (sscanf(optarg, "%u", &mib) < 1 || mib == 0) {
+          fprintf(stderr, "%s: invalid memory budget\n", argv[0]);
+          goto fail;
+        }
+        params.memory_budget = (uint64_t) mib << 20;
+        break;
+
+      case 'x':
+        params.sample = TRUE;
+        if (optarg != NULL
+            && sscanf(optarg, "%" SCNu64, &params.seed) < 1) {
+          fprintf(stderr, "%s: invalid seed\n", argv[0]);
+          goto fail;
+        }
+        break;
+
+      case 'u':
+        params.unique = TRUE;
+        break;
+
+      case 'S':
+        stream = TRUE;
+        break;
+
+      case 's':
+        TRY(softdup = strdup(optarg));
+        params.softfile = softdup;
+        break;
+
+      case 'm':
+        if (strcmp(optarg, "min") == 0) {
+          params.soft_metric = CCCRACK_SOFT_METRIC_MIN;
+        } else if (strcmp(optarg, "sum") == 0) {
+          params.soft_metric = CCCRACK_SOFT_METRIC_SUM;
+        } else {
+          fprintf(stderr, "%s: invalid soft metric `%s'\n", argv[0], optarg);
+          goto fail;
+        }
+        break;
+
       case 'n':
         params.no_gray = TRUE;
         break;
@@ -201,12 +536,26 @@ main(int argc, char *argv[], char *envp[])
     }
   }
 
+  /* Streams cannot be scanned beforehand to guess the symbol size */
+  if (stream && params.bps == 0) {
+    fprintf(stderr, "%s: stream mode requires -b\n", argv[0]);
+    goto fail;
+  }
+
+  if (params.dumpfile != NULL && params.tagging == -1) {
+    fprintf(stderr, "%s: dumping requires -t\n", argv[0]);
+    goto fail;
+  }
+
   if (optind == argc) {
     fprintf(stderr, "%s: no files provided\n\n", argv[0]);
     help(argv[0]);
   } else {
     while (optind < argc)
-      (void) work(argv[0], argv[optind++], &params);
+      if (stream)
+        (void) work_stream(argv[0], argv[optind++], &params);
+      else
+        (void) work(argv[0], argv[optind++], &params);
   }
 
   errcode = EXIT_SUCCESS;
@@ -215,6 +564,12 @@ fail:
   if (pathdup != NULL)
     free(pathdup);
 
+  if (softdup != NULL)
+    free(softdup);
+
+  if (decodedup != NULL)
+    free(decodedup);
+
   exit(errcode);
 }
 
@@ -222,6 +222,41 @@ ptr_list_append (void ***list, int *count, void *new)
   (void) ptr_list_append_check (list, count, new);
 }
 
+int
+vector_reserve (void **list, unsigned int *alloc, unsigned int n, size_t size)
+{
+  unsigned int new_alloc;
+  void *reallocd_list;
+
+  if (n <= *alloc)
+    return 0;
+
+  new_alloc = *alloc < 8 ? 8 : *alloc;
+
+  while (new_alloc < n)
+    new_alloc <<= 1;
+
+  if ((reallocd_list = realloc (*list, new_alloc * size)) == NULL)
+    return -1;
+
+  *list  = reallocd_list;
+  *alloc = new_alloc;
+
+  return 0;
+}
+
+/* SplitMix64. Fast and reproducible, not meant for cryptography */
+uint64_t
+splitmix64_next (uint64_t *state)
+{
+  uint64_t z = (*state += 0x9e3779b97f4a7c15ull);
+
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+
+  return z ^ (z >> 31);
+}
+
 int
 ptr_list_remove_first (void ***list, int *count, void *ptr)
 {
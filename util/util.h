@@ -23,6 +23,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <errno.h>
 #include <stdarg.h>
 #include <sys/types.h>
@@ -130,6 +131,43 @@
   ptr_list_remove_first ((void ***) &JOIN (name, _list),   \
                    &JOIN (name, _count), ptr)
 
+/*
+ * Typed, contiguous vectors. Unlike PTR_LIST, storage grows geometrically
+ * and pushes never look for free slots, so appending is amortized O(1).
+ */
+#define VECTOR(type, name)                           \
+  type *       name ## _list;                        \
+  unsigned int name ## _count;                       \
+  unsigned int name ## _alloc;
+
+#define VECTOR_INIT(where, name)                     \
+  where->name ## _list = NULL;                       \
+  where->name ## _count = 0;                         \
+  where->name ## _alloc = 0;
+
+#define VECTOR_RESERVE(name, n)                              \
+  vector_reserve ((void **) &JOIN (name, _list),             \
+                  &JOIN (name, _alloc),                      \
+                  n,                                         \
+                  sizeof (*JOIN (name, _list)))
+
+/* Evaluates to the index of the new element, or -1 on failure */
+#define VECTOR_PUSH(name, val)                               \
+  ((JOIN (name, _count) < JOIN (name, _alloc)                \
+    || VECTOR_RESERVE (name, JOIN (name, _count) + 1) != -1) \
+   ? (int) (JOIN (name, _list)[JOIN (name, _count)] = (val), \
+            JOIN (name, _count)++)                           \
+   : -1)
+
+#define VECTOR_FREE(name)                                    \
+  do {                                                       \
+    if (JOIN (name, _list) != NULL)                          \
+      free (JOIN (name, _list));                             \
+    JOIN (name, _list) = NULL;                               \
+    JOIN (name, _count) = 0;                                 \
+    JOIN (name, _alloc) = 0;                                 \
+  } while (0)
+
 #define FOR_EACH_PTR(this, where, name)              \
   int JOIN (_idx_, __LINE__);                             \
   for (JOIN (_idx_, __LINE__) = 0;                        \
@@ -174,6 +212,8 @@ void ptr_list_append (void ***, int *, void *);
 int  ptr_list_append_check (void ***, int *, void *);
 int  ptr_list_remove_first (void ***, int *, void *);
 int  ptr_list_remove_all (void ***, int *, void *);
+int  vector_reserve (void **, unsigned int *, unsigned int, size_t);
+uint64_t splitmix64_next (uint64_t *);
 
 void errno_save (void);
 void errno_restore (void);